@@ -0,0 +1,401 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include "fundamental_types.h"
+
+#if defined(__GNUC__)
+#define ALIGNED_ARRAY_ASSUME_ALIGNED(ptr, alignment) \
+    static_cast<decltype(ptr)>(__builtin_assume_aligned((ptr), (alignment)))
+#else
+#define ALIGNED_ARRAY_ASSUME_ALIGNED(ptr, alignment) (ptr)
+#endif
+
+/**
+ * \brief Owns a dynamically allocated array of count elements whose storage
+ *  is aligned to alignment bytes (64 by default, one cache line and one
+ *  AVX-512 register). Unlike scoped_ptr<T, default_array_storage>, the array
+ *  knows its length. The allocation is padded to a multiple of the alignment,
+ *  so that kernels may process whole vectors up to the end of the storage.
+ *  Elements are value initialized.
+ * \remarks As with the other owners in this library, access to the underlying
+ *  pointer goes through the aligned_array_get() friend function.
+ * \see bulk_fill, bulk_copy, bulk_equal, bulk_sum, bulk_min, bulk_max
+ */
+template<typename T, size_t alignment = 64>
+class aligned_array {
+public :
+    static_assert((alignment & (alignment - 1)) == 0,
+                  "Alignment must be a power of two!");
+    static_assert(alignment >= alignof(T) && alignment >= sizeof(void*),
+                  "Alignment too small for the element type!");
+
+    typedef aligned_array<T, alignment>     self_t;
+    typedef T                               value_type;
+    typedef T*                              pointer_t;
+    typedef const T*                        const_pointer_t;
+    typedef T&                              ref_t;
+    typedef const T&                        const_ref_t;
+
+    enum {
+        array_alignment = alignment
+    };
+
+private :
+    /*!< Aligned storage, nullptr for an empty array. */
+    T*      data_;
+    /*!< Number of elements. */
+    size_t  size_;
+
+    aligned_array(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    static T* allocate(size_t count) {
+        if (!count)
+            return nullptr;
+
+        // The size rounded up to the alignment must not wrap around.
+        if (count > (SIZE_MAX - (alignment - 1)) / sizeof(T))
+            throw std::bad_alloc();
+        const size_t bytes =
+                (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+        void* memory = nullptr;
+        if (posix_memalign(&memory, alignment, bytes))
+            throw std::bad_alloc();
+        return static_cast<T*>(memory);
+    }
+
+    static void construct(T* data, size_t count, std::true_type) {
+        std::memset(data, 0, count * sizeof(T));
+    }
+
+    static void construct(T* data, size_t count, std::false_type) {
+        size_t i = 0;
+        try {
+            for (; i < count; ++i)
+                new (data + i) T();
+        } catch (...) {
+            destroy(data, i, std::false_type());
+            std::free(data);
+            throw;
+        }
+    }
+
+    static void destroy(T*, size_t, std::true_type) {}
+
+    static void destroy(T* data, size_t count, std::false_type) {
+        while (count)
+            data[--count].~T();
+    }
+
+    typedef std::integral_constant<
+        bool, is_builtin_type<typename std::remove_cv<T>::type>::Yes
+    > trivial_t;
+
+    void dispose() {
+        if (data_) {
+            destroy(data_, size_, trivial_t());
+            std::free(data_);
+        }
+    }
+
+public :
+    aligned_array() : data_(nullptr), size_(0) {}
+
+    explicit aligned_array(size_t count)
+        : data_(allocate(count)), size_(count) {
+        if (data_)
+            construct(data_, size_, trivial_t());
+    }
+
+    aligned_array(self_t&& other) : data_(other.data_), size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    ~aligned_array() {
+        dispose();
+    }
+
+    self_t& operator=(self_t&& other) {
+        if (this != &other) {
+            dispose();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    T& operator[](size_t index) {
+        assert(index < size_);
+        return data_[index];
+    }
+
+    const T& operator[](size_t index) const {
+        assert(index < size_);
+        return data_[index];
+    }
+
+    bool operator!() const {
+        return size_ == 0;
+    }
+
+    friend inline T* aligned_array_get(self_t& arr) {
+        return ALIGNED_ARRAY_ASSUME_ALIGNED(arr.data_, alignment);
+    }
+
+    friend inline const T* aligned_array_get(const self_t& arr) {
+        return ALIGNED_ARRAY_ASSUME_ALIGNED(
+                    static_cast<const T*>(arr.data_), alignment);
+    }
+
+    friend inline size_t aligned_array_size(const self_t& arr) {
+        return arr.size_;
+    }
+
+    friend inline void swap(self_t& left, self_t& right) {
+        std::swap(left.data_, right.data_);
+        std::swap(left.size_, right.size_);
+    }
+};
+
+/**
+ * \brief Bulk kernels. The specialization for builtin types works on the
+ *  aligned pointers directly, in loops shaped so the compiler can vectorize
+ *  them: fixed size blocks, and several independent accumulators for the
+ *  reductions. Other types use the generic algorithms.
+ */
+template<typename T, size_t alignment,
+         int builtin = is_builtin_type<typename std::remove_cv<T>::type>::Yes>
+struct bulk_kernels {
+    static void fill(T* data, size_t count, const T& value) {
+        std::fill(data, data + count, value);
+    }
+
+    static void copy(T* dst, const T* src, size_t count) {
+        std::copy(src, src + count, dst);
+    }
+
+    static bool equal(const T* left, const T* right, size_t count) {
+        return std::equal(left, left + count, right);
+    }
+
+    static T sum(const T* data, size_t count) {
+        T result = T();
+        for (size_t i = 0; i < count; ++i)
+            result = result + data[i];
+        return result;
+    }
+
+    static T min(const T* data, size_t count) {
+        return *std::min_element(data, data + count);
+    }
+
+    static T max(const T* data, size_t count) {
+        return *std::max_element(data, data + count);
+    }
+};
+
+template<typename T, size_t alignment>
+struct bulk_kernels<T, alignment, 1> {
+    enum {
+        /*!< Number of independent accumulators used by the reductions. */
+        lanes = 8,
+        /*!< Elements compared before checking for a mismatch. */
+        compare_block = 64
+    };
+
+    static void fill(T* data, size_t count, T value) {
+        data = ALIGNED_ARRAY_ASSUME_ALIGNED(data, alignment);
+        for (size_t i = 0; i < count; ++i)
+            data[i] = value;
+    }
+
+    static void copy(T* dst, const T* src, size_t count) {
+        if (!count)
+            return;
+        std::memcpy(ALIGNED_ARRAY_ASSUME_ALIGNED(dst, alignment),
+                    ALIGNED_ARRAY_ASSUME_ALIGNED(src, alignment),
+                    count * sizeof(T));
+    }
+
+    static bool equal(const T* left, const T* right, size_t count) {
+        left = ALIGNED_ARRAY_ASSUME_ALIGNED(left, alignment);
+        right = ALIGNED_ARRAY_ASSUME_ALIGNED(right, alignment);
+
+        size_t i = 0;
+        for (; i + compare_block <= count; i += compare_block) {
+            bool mismatch = false;
+            for (size_t j = i; j < i + compare_block; ++j)
+                mismatch |= !(left[j] == right[j]);
+            if (mismatch)
+                return false;
+        }
+        for (; i < count; ++i)
+            if (!(left[i] == right[i]))
+                return false;
+        return true;
+    }
+
+    static T sum(const T* data, size_t count) {
+        data = ALIGNED_ARRAY_ASSUME_ALIGNED(data, alignment);
+
+        T partial[lanes] = {};
+        size_t i = 0;
+        for (; i + lanes <= count; i += lanes)
+            for (size_t lane = 0; lane < lanes; ++lane)
+                partial[lane] += data[i + lane];
+
+        T result = T();
+        for (size_t lane = 0; lane < lanes; ++lane)
+            result += partial[lane];
+        for (; i < count; ++i)
+            result += data[i];
+        return result;
+    }
+
+    static T min(const T* data, size_t count) {
+        data = ALIGNED_ARRAY_ASSUME_ALIGNED(data, alignment);
+
+        size_t i = 0;
+        T result = data[0];
+        if (count >= lanes) {
+            T partial[lanes];
+            for (size_t lane = 0; lane < lanes; ++lane)
+                partial[lane] = data[lane];
+            for (i = lanes; i + lanes <= count; i += lanes)
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    partial[lane] = data[i + lane] < partial[lane]
+                            ? data[i + lane] : partial[lane];
+            for (size_t lane = 0; lane < lanes; ++lane)
+                result = partial[lane] < result ? partial[lane] : result;
+        }
+        for (; i < count; ++i)
+            result = data[i] < result ? data[i] : result;
+        return result;
+    }
+
+    static T max(const T* data, size_t count) {
+        data = ALIGNED_ARRAY_ASSUME_ALIGNED(data, alignment);
+
+        size_t i = 0;
+        T result = data[0];
+        if (count >= lanes) {
+            T partial[lanes];
+            for (size_t lane = 0; lane < lanes; ++lane)
+                partial[lane] = data[lane];
+            for (i = lanes; i + lanes <= count; i += lanes)
+                for (size_t lane = 0; lane < lanes; ++lane)
+                    partial[lane] = partial[lane] < data[i + lane]
+                            ? data[i + lane] : partial[lane];
+            for (size_t lane = 0; lane < lanes; ++lane)
+                result = result < partial[lane] ? partial[lane] : result;
+        }
+        for (; i < count; ++i)
+            result = result < data[i] ? data[i] : result;
+        return result;
+    }
+};
+
+/**
+ * \brief Sets all the elements of the array to value.
+ */
+template<typename T, size_t A>
+inline void bulk_fill(aligned_array<T, A>& arr, const T& value) {
+    bulk_kernels<T, A>::fill(aligned_array_get(arr), aligned_array_size(arr),
+                             value);
+}
+
+/**
+ * \brief Copies the elements of src into dst. Both arrays must have the same
+ *  size.
+ */
+template<typename T, size_t A>
+inline void bulk_copy(aligned_array<T, A>& dst, const aligned_array<T, A>& src) {
+    assert(aligned_array_size(dst) == aligned_array_size(src));
+    bulk_kernels<T, A>::copy(aligned_array_get(dst), aligned_array_get(src),
+                             aligned_array_size(src));
+}
+
+/**
+ * \brief Compares two arrays element by element.
+ */
+template<typename T, size_t A>
+inline bool bulk_equal(const aligned_array<T, A>& left,
+                       const aligned_array<T, A>& right) {
+    return aligned_array_size(left) == aligned_array_size(right) &&
+            bulk_kernels<T, A>::equal(aligned_array_get(left),
+                                      aligned_array_get(right),
+                                      aligned_array_size(left));
+}
+
+/**
+ * \brief Returns the sum of the elements, T() for an empty array.
+ * \remarks For floating point types the elements are summed in a different
+ *  order than a sequential loop would, so the result may differ in the last
+ *  bits.
+ */
+template<typename T, size_t A>
+inline T bulk_sum(const aligned_array<T, A>& arr) {
+    return bulk_kernels<T, A>::sum(aligned_array_get(arr),
+                                   aligned_array_size(arr));
+}
+
+/**
+ * \brief Returns the smallest element. The array must not be empty.
+ */
+template<typename T, size_t A>
+inline T bulk_min(const aligned_array<T, A>& arr) {
+    assert(aligned_array_size(arr) != 0);
+    return bulk_kernels<T, A>::min(aligned_array_get(arr),
+                                   aligned_array_size(arr));
+}
+
+/**
+ * \brief Returns the largest element. The array must not be empty.
+ */
+template<typename T, size_t A>
+inline T bulk_max(const aligned_array<T, A>& arr) {
+    assert(aligned_array_size(arr) != 0);
+    return bulk_kernels<T, A>::max(aligned_array_get(arr),
+                                   aligned_array_size(arr));
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <new>
+#include <string>
+#include "aligned_array.h"
+
+TEST(aligned_array, alignment_and_size) {
+    aligned_array<float> floats(37);
+    EXPECT_EQ(37u, aligned_array_size(floats));
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(aligned_array_get(floats)) % 64);
+    for (size_t i = 0; i < aligned_array_size(floats); ++i)
+        EXPECT_EQ(0.0f, floats[i]);
+
+    aligned_array<double, 32> doubles(5);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(aligned_array_get(doubles)) % 32);
+
+    aligned_array<int> empty;
+    EXPECT_TRUE(!empty);
+    EXPECT_EQ(0, bulk_sum(empty));
+}
+
+TEST(aligned_array, oversized_count) {
+    // count * sizeof(double) wraps around to a tiny allocation.
+    EXPECT_THROW(aligned_array<double>(SIZE_MAX / 4), std::bad_alloc);
+    EXPECT_THROW(aligned_array<char>(SIZE_MAX), std::bad_alloc);
+}
+
+TEST(aligned_array, move) {
+    aligned_array<std::string> first(3);
+    first[1] = "value";
+
+    aligned_array<std::string> second(std::move(first));
+    EXPECT_TRUE(!first);
+    EXPECT_EQ("value", second[1]);
+
+    first = std::move(second);
+    EXPECT_EQ(3u, aligned_array_size(first));
+    EXPECT_EQ(0u, aligned_array_size(second));
+}
+
+TEST(aligned_array, bulk_kernels_builtin) {
+    const size_t kCount = 1003;
+    aligned_array<int> values(kCount);
+    bulk_fill(values, 2);
+    EXPECT_EQ(2 * static_cast<int>(kCount), bulk_sum(values));
+
+    values[500] = -7;
+    values[1001] = 99;
+    EXPECT_EQ(-7, bulk_min(values));
+    EXPECT_EQ(99, bulk_max(values));
+
+    aligned_array<int> copy(kCount);
+    EXPECT_FALSE(bulk_equal(values, copy));
+    bulk_copy(copy, values);
+    EXPECT_TRUE(bulk_equal(values, copy));
+    copy[1002] = 0;
+    EXPECT_FALSE(bulk_equal(values, copy));
+
+    aligned_array<double> small(3);
+    small[0] = 1.5;
+    small[2] = -0.5;
+    EXPECT_DOUBLE_EQ(1.0, bulk_sum(small));
+    EXPECT_DOUBLE_EQ(-0.5, bulk_min(small));
+    EXPECT_DOUBLE_EQ(1.5, bulk_max(small));
+}
+
+TEST(aligned_array, bulk_kernels_generic) {
+    aligned_array<std::string> left(4);
+    aligned_array<std::string> right(4);
+    bulk_fill(left, std::string("a"));
+    left[2] = "c";
+    bulk_copy(right, left);
+    EXPECT_TRUE(bulk_equal(left, right));
+    EXPECT_EQ("aaca", bulk_sum(left));
+    EXPECT_EQ("a", bulk_min(left));
+    EXPECT_EQ("c", bulk_max(left));
+}
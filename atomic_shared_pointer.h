@@ -0,0 +1,195 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include "epoch_reclamation.h"
+#include "shared_pointer.h"
+
+/**
+ * \brief True if a reference policy declares is_thread_safe = 1. Policies
+ *      that do not declare it are assumed not to be thread safe.
+ */
+template<typename policy>
+struct reference_policy_is_thread_safe {
+private :
+    template<typename P>
+    static std::integral_constant<bool, P::is_thread_safe != 0> test(int);
+
+    template<typename>
+    static std::false_type test(...);
+
+public :
+    enum {
+        value = decltype(test<policy>(0))::value
+    };
+};
+
+/**
+ * \brief A shared_pointer slot that can be read and replaced concurrently,
+ *      without locks. Meant for publishing shared state (configuration,
+ *      routing tables) that many threads read and few threads replace.
+ *
+ *  The slot holds one reference to the object it points to. Loading the
+ *  pointer takes a new reference inside an epoch_guard critical section.
+ *  Replacing the pointer retires the reference held by the slot to the
+ *  epoch_domain, instead of dropping it immediately, so that a reader
+ *  that has read the old pointer but not yet incremented its count never
+ *  sees the object destroyed. Readers therefore never serialize on a lock.
+ * \remarks The reference_policy<T> policy must be safe to use from several
+ *      threads at once (atomic_intrusive_refcount, control_block_refcount,
+ *      weak_intrusive_refcount, biased_refcount), which is checked at
+ *      compile time through its is_thread_safe constant.
+ * \see shared_pointer, epoch_domain
+ */
+template<
+        typename T,
+        template<typename> class reference_policy = atomic_intrusive_refcount,
+        template<typename> class storage_policy = default_storage,
+        template<typename> class checking_policy = assert_check
+> class atomic_shared_pointer {
+public :
+    typedef reference_policy<T>                                 refpolicy_t;
+    typedef storage_policy<T>                                   spolicy_t;
+    typedef shared_pointer<
+        T, reference_policy, storage_policy, checking_policy
+    > shared_t;
+    typedef atomic_shared_pointer<
+        T, reference_policy, storage_policy, checking_policy
+    > self_t;
+
+    static_assert(reference_policy_is_thread_safe<refpolicy_t>::value,
+                  "The reference policy must be thread safe!");
+
+private :
+    /*!< Current object, the slot owns one reference to it. */
+    std::atomic<T*>     pointee_;
+
+    static T* raw_pointer(const shared_t& sp) {
+        return sp ? shared_ptr_get(sp) : nullptr;
+    }
+
+    static void release_reference(void* ptr) {
+        T* obj = static_cast<T*>(ptr);
+        if (refpolicy_t::dec_ref(obj))
+            spolicy_t::dispose(obj);
+    }
+
+    /**
+     * \brief Drops the reference held by the slot to an object that has been
+     *      unlinked, once no reader can still be about to increment it.
+     */
+    static void retire_reference(T* ptr) {
+        if (ptr)
+            epoch_domain::instance().retire(ptr, &release_reference);
+    }
+
+public :
+    atomic_shared_pointer() : pointee_(nullptr) {}
+
+    explicit atomic_shared_pointer(shared_t desired)
+        : pointee_(shared_ptr_release(std::move(desired))) {}
+
+    ~atomic_shared_pointer() {
+        retire_reference(pointee_.load(std::memory_order_relaxed));
+    }
+
+    atomic_shared_pointer(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    /**
+     * \brief Returns a shared_pointer to the current object.
+     */
+    shared_t load() const {
+        epoch_guard guard;
+        T* ptr = pointee_.load(std::memory_order_acquire);
+        refpolicy_t::add_ref(ptr);
+        return shared_t(ptr);
+    }
+
+    /**
+     * \brief Replaces the current object.
+     */
+    void store(shared_t desired) {
+        retire_reference(pointee_.exchange(
+                             shared_ptr_release(std::move(desired)),
+                             std::memory_order_acq_rel));
+    }
+
+    /**
+     * \brief Replaces the current object and returns the previous one.
+     */
+    shared_t exchange(shared_t desired) {
+        T* old = pointee_.exchange(shared_ptr_release(std::move(desired)),
+                                   std::memory_order_acq_rel);
+        //
+        // The reference held by the slot is retired rather than handed to
+        // the caller, since readers may still be about to increment it.
+        refpolicy_t::add_ref(old);
+        retire_reference(old);
+        return shared_t(old);
+    }
+
+    /**
+     * \brief Replaces the current object with desired, if the current
+     *      object is the one referred to by expected.
+     * \param expected On failure, receives the current object.
+     * \param desired The new object.
+     * \return True if the object was replaced.
+     */
+    bool compare_exchange(shared_t& expected, shared_t desired) {
+        epoch_guard guard;
+        T* current = raw_pointer(expected);
+        T* replacement = raw_pointer(desired);
+
+        if (pointee_.compare_exchange_strong(current, replacement,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+            shared_ptr_release(std::move(desired));
+            retire_reference(current);
+            return true;
+        }
+
+        //
+        // The guard was entered before current was read, so the object
+        // cannot have been released yet.
+        refpolicy_t::add_ref(current);
+        expected = shared_t(current);
+        return false;
+    }
+
+    bool is_lock_free() const {
+        return pointee_.is_lock_free();
+    }
+};
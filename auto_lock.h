@@ -31,19 +31,63 @@
 
 #pragma once
 
+#include "lock_waiter.h"
+
+/**
+ * \brief Acquires and releases a lock, passing the waiter state when the
+ *      lock requires one.
+ */
+template<typename LockT, typename WaiterT = typename lock_waiter<LockT>::type>
+struct lock_waiter_ops {
+    __attribute__((always_inline))
+    static void acquire(LockT& lock, WaiterT& waiter) {
+        lock.acquire(waiter);
+    }
+
+    static void release(LockT& lock, WaiterT& waiter) {
+        lock.release(waiter);
+    }
+
+    static bool try_acquire(LockT& lock, WaiterT& waiter) {
+        return lock.try_acquire(waiter);
+    }
+};
+
+template<typename LockT>
+struct lock_waiter_ops<LockT, no_waiter> {
+    __attribute__((always_inline))
+    static void acquire(LockT& lock, no_waiter&) {
+        lock.acquire();
+    }
+
+    static void release(LockT& lock, no_waiter&) {
+        lock.release();
+    }
+
+    static bool try_acquire(LockT& lock, no_waiter&) {
+        return lock.try_acquire();
+    }
+};
+
 /**
  * \brief Helper class to automate acquiring and releasing a lock. It will
  *      acquire the lock in the constructor and release it in the
  *      destructor. It is designed so that it can be used with a class
  *      that abstracts a locking primitive, provided that the class has
  *      two functions called acquire() and release() in the public part of
- *      its interface.
+ *      its interface. If the class declares a waiter_t type (queue locks,
+ *      see lock_waiter), the guard holds the waiter state of the calling
+ *      thread and passes it to acquire(waiter_t&) and release(waiter_t&).
  */
 template<typename LockT>
 class auto_lock {
 private :
+    typedef typename lock_waiter<LockT>::type   waiter_t;
+
     /*!< Reference to an existing locking class object */
-    LockT&  lock_;
+    LockT&      lock_;
+    /*!< Queue node of this thread, for locks that need one */
+    waiter_t    waiter_;
 
 public :
     /**
@@ -52,17 +96,63 @@ public :
      *      implement two functions called acquire() and release().
      * \see scoped_lock class.
      */
-    auto_lock(LockT& lock) : lock_(lock) {
-        lock_.acquire();
+    __attribute__((always_inline)) auto_lock(LockT& lock) : lock_(lock) {
+        lock_waiter_ops<LockT>::acquire(lock_, waiter_);
     }
 
     /**
      * \brief The destructor releases the lock when this object expires.
      */
     ~auto_lock() {
-        lock_.release();
+        lock_waiter_ops<LockT>::release(lock_, waiter_);
     }
 
     auto_lock(const auto_lock&) = delete;
     auto_lock& operator=(const auto_lock&) = delete;
 };
+
+/**
+ * \brief Holds a read/write lock for reading, for the lifetime of the object.
+ * \see scoped_rwlock
+ */
+template<typename LockT>
+class auto_read_lock {
+private :
+    /*!< Reference to an existing read/write lock object */
+    LockT&  lock_;
+
+public :
+    explicit auto_read_lock(LockT& lock) : lock_(lock) {
+        lock_.acquire_read();
+    }
+
+    ~auto_read_lock() {
+        lock_.release_read();
+    }
+
+    auto_read_lock(const auto_read_lock&) = delete;
+    auto_read_lock& operator=(const auto_read_lock&) = delete;
+};
+
+/**
+ * \brief Holds a read/write lock for writing, for the lifetime of the object.
+ * \see scoped_rwlock
+ */
+template<typename LockT>
+class auto_write_lock {
+private :
+    /*!< Reference to an existing read/write lock object */
+    LockT&  lock_;
+
+public :
+    explicit auto_write_lock(LockT& lock) : lock_(lock) {
+        lock_.acquire_write();
+    }
+
+    ~auto_write_lock() {
+        lock_.release_write();
+    }
+
+    auto_write_lock(const auto_write_lock&) = delete;
+    auto_write_lock& operator=(const auto_write_lock&) = delete;
+};
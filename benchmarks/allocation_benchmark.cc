@@ -0,0 +1,97 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <vector>
+#include "benchmark_utils.h"
+#include "memory_pool.h"
+#include "monotonic_arena.h"
+#include "scoped_pointer.h"
+
+namespace {
+
+const unsigned int kRequests = 20000;
+const unsigned int kObjectsPerRequest = 64;
+
+struct request_object {
+    int     id_;
+    double  payload_[3];
+
+    explicit request_object(int id) : id_(id) {
+        payload_[0] = payload_[1] = payload_[2] = id;
+    }
+};
+
+/**
+ * \brief Simulates a request that creates a batch of objects, touches them
+ *  and releases them all at the end.
+ */
+template<template<typename> class storage_policy, typename create_fn>
+void run_requests(const char* name, create_fn create) {
+    typedef scoped_ptr<request_object, storage_policy> pointer_t;
+
+    std::vector<pointer_t> objects(kObjectsPerRequest);
+    stopwatch timer;
+    for (unsigned int request = 0; request < kRequests; ++request) {
+        for (unsigned int i = 0; i < kObjectsPerRequest; ++i)
+            scoped_pointer_reset(objects[i], create(i));
+        for (unsigned int i = 0; i < kObjectsPerRequest; ++i)
+            do_not_optimize(objects[i]->id_);
+        for (unsigned int i = 0; i < kObjectsPerRequest; ++i)
+            scoped_pointer_reset(objects[i]);
+    }
+    report_result(name, timer.elapsed_ns(),
+                  static_cast<unsigned long long>(kRequests) * kObjectsPerRequest);
+}
+
+} // anonymous namespace
+
+void run_allocation_benchmark() {
+    std::printf("\nrequest scoped allocations, per object\n");
+
+    run_requests<default_storage>("scoped_ptr default_storage", [](int id) {
+        return new request_object(id);
+    });
+
+    pooled_storage<request_object>::prewarm(kObjectsPerRequest);
+    run_requests<pooled_storage>("scoped_ptr pooled_storage", [](int id) {
+        return pooled_storage<request_object>::create(id);
+    });
+
+    monotonic_arena arena;
+    unsigned int created = 0;
+    run_requests<arena_storage>("scoped_ptr arena_storage",
+                                [&arena, &created](int id) {
+        // The arena is reset when the previous request has completed.
+        if (created++ % kObjectsPerRequest == 0)
+            arena.reset();
+        return arena.create<request_object>(id);
+    });
+}
@@ -0,0 +1,75 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+/**
+ * \brief Prevents the compiler from optimizing away the computation of a
+ *      value that is otherwise unused in a benchmark loop.
+ */
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * \brief Measures the wall clock time elapsed since its construction.
+ */
+class stopwatch {
+private :
+    typedef std::chrono::steady_clock   clock_t;
+
+    clock_t::time_point start_;
+
+public :
+    stopwatch() : start_(clock_t::now()) {}
+
+    double elapsed_ns() const {
+        return std::chrono::duration<double, std::nano>(
+                    clock_t::now() - start_).count();
+    }
+};
+
+/**
+ * \brief Prints one line of benchmark results.
+ */
+inline void report_result(const char* name, double total_ns,
+                          unsigned long long iterations) {
+    std::printf("%-48s %12.2f ns/op\n", name, total_ns / iterations);
+}
+
+void run_refcount_benchmark();
+void run_epoch_benchmark();
+void run_allocation_benchmark();
+void run_lock_benchmark();
@@ -0,0 +1,19 @@
+TEMPLATE = app
+TARGET = benchmarks
+CONFIG += console thread
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+unix {
+    QMAKE_CXXFLAGS += -std=c++0x -Wall -Wextra -O2
+}
+
+SOURCES += main.cpp \
+    refcount_benchmark.cc \
+    epoch_benchmark.cc \
+    allocation_benchmark.cc \
+    lock_benchmark.cc
+
+HEADERS += \
+    benchmark_utils.h
@@ -0,0 +1,132 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <thread>
+#include <vector>
+#include "atomic_shared_pointer.h"
+#include "auto_lock.h"
+#include "benchmark_utils.h"
+#include "epoch_reclamation.h"
+#include "posix_lock.h"
+#include "scoped_lock.h"
+#include "shared_pointer.h"
+
+namespace {
+
+const unsigned int kReadsPerThread = 5000000;
+
+class routing_table : public atomic_intrusive_refcount_impl {
+public :
+    int weights_[16];
+
+    routing_table() {
+        for (int i = 0; i < 16; ++i)
+            weights_[i] = i;
+    }
+};
+
+typedef shared_pointer<
+    routing_table, atomic_intrusive_refcount, epoch_storage
+> table_ptr_t;
+
+/**
+ * \brief Runs the read loop on a number of threads and reports the total
+ *  reader throughput.
+ */
+template<typename read_fn>
+void run_readers(const char* name, unsigned int threads, read_fn read) {
+    std::atomic<bool> start(false);
+    std::vector<std::thread> readers;
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        readers.push_back(std::thread([&start, &read]() {
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            int sum = 0;
+            for (unsigned int j = 0; j < kReadsPerThread; ++j)
+                sum += read(j & 15);
+            do_not_optimize(sum);
+        }));
+    }
+
+    stopwatch timer;
+    start.store(true, std::memory_order_release);
+    for (size_t i = 0; i < readers.size(); ++i)
+        readers[i].join();
+
+    const double seconds = timer.elapsed_ns() / 1e9;
+    std::printf("%-32s threads %3u %12.2f Mreads/s\n", name, threads,
+                threads * static_cast<double>(kReadsPerThread) / seconds / 1e6);
+}
+
+} // anonymous namespace
+
+void run_epoch_benchmark() {
+    std::printf("\nread-mostly lookups, reader throughput\n");
+
+    table_ptr_t table(new routing_table());
+    std::atomic<routing_table*> published(shared_ptr_get(table));
+    atomic_shared_pointer<
+        routing_table, atomic_intrusive_refcount, epoch_storage
+    > atomic_table(table);
+    scoped_lock<posix_mutex_traits> table_lock;
+
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 4;
+
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        run_readers("refcounted copy", threads, [&table](unsigned int idx) {
+            table_ptr_t local(table);
+            return local->weights_[idx];
+        });
+
+        run_readers("epoch_guard", threads, [&published](unsigned int idx) {
+            epoch_guard guard;
+            return published.load(std::memory_order_acquire)->weights_[idx];
+        });
+
+        run_readers("mutex + copy", threads,
+                    [&table, &table_lock](unsigned int idx) {
+            table_ptr_t local;
+            {
+                auto_lock<scoped_lock<posix_mutex_traits> > guard(table_lock);
+                local = table;
+            }
+            return local->weights_[idx];
+        });
+
+        run_readers("atomic_shared_pointer::load", threads,
+                    [&atomic_table](unsigned int idx) {
+            return atomic_table.load()->weights_[idx];
+        });
+    }
+}
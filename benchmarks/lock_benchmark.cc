@@ -0,0 +1,216 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "auto_lock.h"
+#include "benchmark_utils.h"
+#include "biased_rwlock.h"
+#include "futex_lock.h"
+#include "multi_lock.h"
+#include "posix_lock.h"
+#include "scoped_lock.h"
+#include "spin_lock.h"
+
+namespace {
+
+const unsigned int kAcquiresPerThread = 1000000;
+
+/**
+ * \brief Runs a short critical section on a number of threads and reports
+ *  the average time per acquire/release pair.
+ */
+template<typename lock_type>
+void run_contended(const char* name, unsigned int threads) {
+    lock_type lock;
+    unsigned long shared_counter = 0;
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&lock, &shared_counter, &start]() {
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (unsigned int j = 0; j < kAcquiresPerThread; ++j) {
+                auto_lock<lock_type> guard(lock);
+                ++shared_counter;
+            }
+        }));
+    }
+
+    stopwatch timer;
+    start.store(true, std::memory_order_release);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    do_not_optimize(shared_counter);
+    std::printf("%-32s threads %3u %12.2f ns/op\n", name, threads,
+                timer.elapsed_ns() / (threads * static_cast<double>(
+                                          kAcquiresPerThread)));
+}
+
+/**
+ * \brief Table lookups under a read/write lock, with one write per 100
+ *  operations.
+ */
+template<typename rwlock_type>
+void run_read_mostly(const char* name, unsigned int threads) {
+    rwlock_type lock;
+    int table[16] = {};
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&lock, &table, &start]() {
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            int sum = 0;
+            for (unsigned int j = 0; j < kAcquiresPerThread; ++j) {
+                if (j % 100 == 0) {
+                    auto_write_lock<rwlock_type> guard(lock);
+                    ++table[j & 15];
+                } else {
+                    auto_read_lock<rwlock_type> guard(lock);
+                    sum += table[j & 15];
+                }
+            }
+            do_not_optimize(sum);
+        }));
+    }
+
+    stopwatch timer;
+    start.store(true, std::memory_order_release);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    std::printf("%-32s threads %3u %12.2f ns/op\n", name, threads,
+                timer.elapsed_ns() / (threads * static_cast<double>(
+                                          kAcquiresPerThread)));
+}
+
+typedef scoped_lock<futex_mutex_traits> account_lock_t;
+
+/**
+ * \brief Takes the locks of two accounts nested, lower address first.
+ */
+struct ordered_pair_lock {
+    auto_lock<account_lock_t>   first_;
+    auto_lock<account_lock_t>   second_;
+
+    ordered_pair_lock(account_lock_t& a, account_lock_t& b)
+        :       first_(&a < &b ? a : b),
+                second_(&a < &b ? b : a) {}
+};
+
+/**
+ * \brief Takes the locks of two accounts with auto_multi_lock.
+ */
+struct multi_pair_lock {
+    auto_multi_lock<account_lock_t, account_lock_t>     guard_;
+
+    multi_pair_lock(account_lock_t& a, account_lock_t& b) : guard_(a, b) {}
+};
+
+/**
+ * \brief Transfers between pairs of 8 accounts, each under both account
+ *  locks.
+ */
+template<typename pair_lock_type>
+void run_transfers(const char* name, unsigned int threads) {
+    const unsigned int kAccounts = 8;
+    account_lock_t locks[kAccounts];
+    long balances[kAccounts] = {};
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&locks, &balances, &start, i]() {
+            while (!start.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            unsigned int seed = i * 7919 + 1;
+            for (unsigned int j = 0; j < kAcquiresPerThread / 4; ++j) {
+                seed = seed * 1103515245 + 12345;
+                const unsigned int from = (seed >> 16) % kAccounts;
+                const unsigned int to = (from + 1 + (seed >> 8) % (kAccounts - 1))
+                        % kAccounts;
+                pair_lock_type guard(locks[from], locks[to]);
+                --balances[from];
+                ++balances[to];
+            }
+        }));
+    }
+
+    stopwatch timer;
+    start.store(true, std::memory_order_release);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    do_not_optimize(balances[0]);
+    std::printf("%-32s threads %3u %12.2f ns/op\n", name, threads,
+                timer.elapsed_ns() / (threads * static_cast<double>(
+                                          kAcquiresPerThread / 4)));
+}
+
+} // anonymous namespace
+
+void run_lock_benchmark() {
+    std::printf("\nlock acquire/release, total time per critical section\n");
+
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 4;
+
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        run_contended<scoped_lock<posix_mutex_traits> >("posix_mutex_traits",
+                                                        threads);
+        run_contended<scoped_lock<futex_mutex_traits> >("futex_mutex_traits",
+                                                        threads);
+        run_contended<scoped_lock<ticket_lock_traits> >("ticket_lock_traits",
+                                                        threads);
+        run_contended<scoped_lock<mcs_lock_traits> >("mcs_lock_traits",
+                                                     threads);
+    }
+
+    std::printf("\nread-mostly lookups (1%% writes), time per operation\n");
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        run_read_mostly<scoped_rwlock<posix_rwlock_traits> >(
+                    "posix_rwlock_traits", threads);
+        run_read_mostly<scoped_rwlock<biased_rwlock_traits<> > >(
+                    "biased_rwlock_traits", threads);
+    }
+
+    std::printf("\ntransfers between two of 8 accounts, time per transfer\n");
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        run_transfers<ordered_pair_lock>("nested, address order", threads);
+        run_transfers<multi_pair_lock>("auto_multi_lock", threads);
+    }
+}
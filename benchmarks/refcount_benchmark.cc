@@ -0,0 +1,141 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "benchmark_utils.h"
+#include "shared_pointer.h"
+
+namespace {
+
+const unsigned long long kIterations = 50000000ULL;
+
+class plain_object : public intrusive_refcount_impl {
+public :
+    int value_;
+
+    plain_object() : value_(0) {}
+};
+
+class biased_object : public biased_refcount_impl {
+public :
+    int value_;
+
+    biased_object() : value_(0) {}
+};
+
+class atomic_object : public atomic_intrusive_refcount_impl {
+public :
+    int value_;
+
+    atomic_object() : value_(0) {}
+};
+
+/**
+ * \brief Third party type, which does not implement reference counting.
+ */
+struct third_party_object {
+    int value_;
+    double weight_;
+
+    third_party_object() : value_(0), weight_(0.0) {}
+};
+
+/**
+ * \brief Wrapper needed to share a third_party_object with an intrusive
+ *  reference count, costing a second allocation.
+ */
+class third_party_wrapper : public atomic_intrusive_refcount_impl {
+public :
+    third_party_object* object_;
+
+    third_party_wrapper() : object_(new third_party_object()) {}
+
+    ~third_party_wrapper() {
+        delete object_;
+    }
+};
+
+/**
+ * \brief Times copying and destroying a shared_pointer on a single thread,
+ *  which is the hot path when a shared object never leaves its thread.
+ */
+template<typename pointer_type>
+void copy_and_destroy(const char* name, const pointer_type& src) {
+    stopwatch timer;
+    for (unsigned long long i = 0; i < kIterations; ++i) {
+        pointer_type copy(src);
+        do_not_optimize(copy);
+    }
+    report_result(name, timer.elapsed_ns(), kIterations);
+}
+
+void create_and_destroy_wrapped() {
+    stopwatch timer;
+    for (unsigned long long i = 0; i < kIterations / 10; ++i) {
+        shared_pointer<third_party_wrapper, atomic_intrusive_refcount> sp(
+                    new third_party_wrapper());
+        do_not_optimize(sp);
+    }
+    report_result("wrapper + atomic_intrusive_refcount",
+                  timer.elapsed_ns(), kIterations / 10);
+}
+
+void create_and_destroy_control_block() {
+    stopwatch timer;
+    for (unsigned long long i = 0; i < kIterations / 10; ++i) {
+        shared_pointer<third_party_object, control_block_refcount,
+                       control_block_storage> sp =
+                make_shared_pointer<third_party_object>();
+        do_not_optimize(sp);
+    }
+    report_result("make_shared_pointer + control_block_refcount",
+                  timer.elapsed_ns(), kIterations / 10);
+}
+
+} // anonymous namespace
+
+void run_refcount_benchmark() {
+    std::printf("shared_pointer copy + destroy, single thread\n");
+
+    shared_pointer<plain_object> plain(new plain_object());
+    copy_and_destroy("intrusive_refcount (plain counter)", plain);
+
+    shared_pointer<atomic_object, atomic_intrusive_refcount> atomic(
+                new atomic_object());
+    copy_and_destroy("atomic_intrusive_refcount", atomic);
+
+    shared_pointer<biased_object, biased_refcount> biased(
+                new biased_object());
+    copy_and_destroy("biased_refcount (owner thread)", biased);
+
+    std::printf("\nshared_pointer create + destroy, third party type\n");
+    create_and_destroy_wrapped();
+    create_and_destroy_control_block();
+}
@@ -0,0 +1,326 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * \brief Helper class, adding biased reference counting to an existing class,
+ *      so that its objects can be used with shared_pointer objects that
+ *      are mostly, but not exclusively, used by the thread that created them.
+ *
+ *  The thread that constructs the object becomes its owner. References
+ *  taken and dropped by the owner update a plain counter, so they cost the
+ *  same as with intrusive_refcount_impl. References taken and dropped by any
+ *  other thread update an atomic shared counter, which may become negative
+ *  when another thread drops a reference created by the owner.
+ *
+ *  The two counters are merged when the owner drops its last biased
+ *  reference, after which all threads use the shared counter. If another
+ *  thread drives the shared counter negative first, it queues the object to
+ *  the owner, which merges it the next time it calls merge_queued() (or
+ *  drops a biased reference to zero). Objects still queued when the owner
+ *  thread exits are merged by the exiting thread, and any object queued
+ *  after that is merged by the thread that queues it.
+ * \remarks Objects whose last reference is dropped while merging a queue
+ *      are destroyed with delete, so they must have been allocated with new;
+ *      shared_pointer only accepts default_storage with biased_refcount.
+ *      Each owner thread allocates a small record, which is freed once the
+ *      thread has exited and all the objects it created are destroyed.
+ * \see shared_pointer, biased_refcount
+ */
+class biased_refcount_impl {
+private :
+    /**
+     * \brief Identifies an owner thread and holds the objects that other
+     *      threads have queued to it for merging.
+     */
+    struct owner_record {
+        std::atomic<const biased_refcount_impl*>    queue_head_;
+        /*!< The owner thread, while it runs, plus the objects it created. */
+        std::atomic<size_t>                         users_;
+
+        explicit owner_record(size_t users)
+            : queue_head_(nullptr), users_(users) {}
+
+        void add_user() {
+            users_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release_user() {
+            if (users_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+    };
+
+    /**
+     * \brief Closes the merge queue of a thread when the thread exits.
+     */
+    struct owner_record_holder {
+        owner_record*   record_;
+
+        owner_record_holder() : record_(nullptr) {}
+
+        ~owner_record_holder() {
+            if (record_) {
+                // Objects released by this thread from now on (eg. from
+                // other thread_local destructors) take the shared path, and
+                // are merged by the releasing thread.
+                current_record() = nullptr;
+                thread_exited() = true;
+                close_queue(record_);
+                record_->release_user();
+            }
+        }
+    };
+
+    enum {
+        merged_flag = 1,
+        queued_flag = 2,
+        flags_mask = 3,
+        count_unit = 4
+    };
+
+    /*!< Owner thread, or unowned() once the counters are merged. */
+    mutable std::atomic<owner_record*>      owner_;
+    /*!< Owner thread at construction, receives queued merge requests. */
+    owner_record* const                     home_;
+    /*!< References held by the owner, only touched by the owner thread. */
+    mutable unsigned int                    biased_;
+    /*!< References held by other threads, in count_unit steps, plus flags. */
+    mutable std::atomic<long>               shared_;
+    /*!< Link in the merge queue of the owner thread. */
+    mutable const biased_refcount_impl*     next_queued_;
+
+    static owner_record*& current_record() {
+        static thread_local owner_record* record = nullptr;
+        return record;
+    }
+
+    static bool& thread_exited() {
+        static thread_local bool exited = false;
+        return exited;
+    }
+
+    static owner_record* current_owner_record() {
+        owner_record*& record = current_record();
+        if (!record) {
+            if (thread_exited()) {
+                // Created during thread exit: the object has no owner that
+                // could merge it, so its record starts closed.
+                owner_record* orphan = new owner_record(0);
+                orphan->queue_head_.store(closed_queue(),
+                                          std::memory_order_relaxed);
+                return orphan;
+            }
+            static thread_local owner_record_holder holder;
+            record = new owner_record(1);
+            holder.record_ = record;
+        }
+        return record;
+    }
+
+    static owner_record* unowned() {
+        static owner_record sentinel(1);
+        return &sentinel;
+    }
+
+    static const biased_refcount_impl* closed_queue() {
+        static const char closed_tag = 0;
+        return reinterpret_cast<const biased_refcount_impl*>(&closed_tag);
+    }
+
+    static bool count_is_zero(long value) {
+        return (value & ~static_cast<long>(flags_mask)) == 0;
+    }
+
+    /**
+     * \brief Called by the owner when its biased count drops to zero.
+     * \return True if no references remain and the object is not queued.
+     */
+    bool merge_on_owner_release() const {
+        owner_.store(unowned(), std::memory_order_relaxed);
+        const long old = shared_.fetch_or(merged_flag,
+                                          std::memory_order_acq_rel);
+
+        merge_queued();
+
+        return !(old & queued_flag) && count_is_zero(old);
+    }
+
+    /**
+     * \brief Called by threads other than the owner to drop a reference.
+     * \return True if this was the last reference to the object.
+     */
+    bool release_shared() const {
+        long old = shared_.load(std::memory_order_relaxed);
+        long desired;
+        bool must_queue;
+
+        do {
+            desired = old - count_unit;
+            must_queue = desired < 0 && !(old & (merged_flag | queued_flag));
+            if (must_queue)
+                desired |= queued_flag;
+        } while (!shared_.compare_exchange_weak(old, desired,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+
+        if (must_queue)
+            return enqueue();
+
+        return (desired & merged_flag) && !(desired & queued_flag) &&
+                count_is_zero(desired);
+    }
+
+    /**
+     * \brief Queues the object to its owner thread for merging.
+     * \return True if the owner thread has exited, the object was merged
+     *      by the calling thread and no references remain.
+     */
+    bool enqueue() const {
+        const biased_refcount_impl* head =
+                home_->queue_head_.load(std::memory_order_acquire);
+
+        do {
+            if (head == closed_queue())
+                return merge_queued_object();
+            next_queued_ = head;
+        } while (!home_->queue_head_.compare_exchange_weak(
+                     head, this, std::memory_order_release,
+                     std::memory_order_acquire));
+
+        return false;
+    }
+
+    /**
+     * \brief Merges the biased count into the shared count and removes
+     *      the queued flag. Must run on the owner thread, or after the
+     *      owner thread has exited.
+     * \return True if no references remain.
+     */
+    bool merge_queued_object() const {
+        long transferred = 0;
+        if (owner_.load(std::memory_order_relaxed) != unowned()) {
+            transferred = static_cast<long>(biased_) * count_unit;
+            biased_ = 0;
+            owner_.store(unowned(), std::memory_order_relaxed);
+        }
+
+        long old = shared_.load(std::memory_order_relaxed);
+        long desired;
+        do {
+            desired = ((old + transferred) | merged_flag) &
+                    ~static_cast<long>(queued_flag);
+        } while (!shared_.compare_exchange_weak(old, desired,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+
+        return count_is_zero(desired);
+    }
+
+    static void merge_list(const biased_refcount_impl* head) {
+        while (head) {
+            const biased_refcount_impl* next = head->next_queued_;
+            // shared_pointer pairs biased_refcount with default_storage
+            // only, so this is what its dispose() would do.
+            if (head->merge_queued_object())
+                delete head;
+            head = next;
+        }
+    }
+
+    static void close_queue(owner_record* record) {
+        merge_list(record->queue_head_.exchange(closed_queue(),
+                                                std::memory_order_acq_rel));
+    }
+
+protected :
+    biased_refcount_impl()
+        :       owner_(current_owner_record()),
+                home_(owner_.load(std::memory_order_relaxed)),
+                biased_(1),
+                shared_(0),
+                next_queued_(nullptr) {
+        home_->add_user();
+    }
+
+    virtual ~biased_refcount_impl() {
+        home_->release_user();
+    }
+
+public :
+    biased_refcount_impl(const biased_refcount_impl&) = delete;
+    biased_refcount_impl& operator=(const biased_refcount_impl&) = delete;
+
+    void add_ref() const {
+        if (owner_.load(std::memory_order_relaxed) == current_record())
+            ++biased_;
+        else
+            shared_.fetch_add(count_unit, std::memory_order_relaxed);
+    }
+
+    bool dec_ref() const {
+        if (owner_.load(std::memory_order_relaxed) == current_record()) {
+            if (--biased_ != 0)
+                return false;
+            return merge_on_owner_release();
+        }
+        return release_shared();
+    }
+
+    /**
+     * \brief Merges the objects that other threads have queued to the
+     *      calling thread. Owner threads that hand objects to other threads
+     *      should call this periodically (for example once per iteration of
+     *      their event loop), so that queued objects are released promptly.
+     */
+    static void merge_queued() {
+        owner_record* record = current_record();
+        if (!record)
+            return;
+
+        // Only the owner thread closes its queue, so a head that is not
+        // closed here stays open until the exchange. A closed queue must
+        // stay closed: objects released by the owner after it closed (eg.
+        // from thread_local or static destructors) would otherwise be queued
+        // to a thread that never merges them again.
+        const biased_refcount_impl* head =
+                record->queue_head_.load(std::memory_order_relaxed);
+        if (!head || head == closed_queue())
+            return;
+
+        merge_list(record->queue_head_.exchange(nullptr,
+                                                std::memory_order_acquire));
+    }
+};
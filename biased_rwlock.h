@@ -0,0 +1,144 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "cpu_relax.h"
+#include "futex_lock.h"
+
+/**
+ * \brief Lock traits for a reader biased read/write lock, usable with
+ *      scoped_rwlock. Readers announce themselves in one of slot_count
+ *      counters, each on its own cache line; threads are assigned slots
+ *      round robin, so concurrent readers running on different threads do
+ *      not write to a shared cache line. Writers are serialized by a futex
+ *      mutex; a writer raises a flag that turns new readers away, and waits
+ *      for the reader counters to drain. Readers turned away sleep on the
+ *      writer mutex until the writer is done.
+ * \remarks Reading is cheap (one atomic increment and a load of a line that
+ *      only changes when writers come and go), writing is expensive (a scan
+ *      of all the slots): use it for data that is read far more often than
+ *      it is written. Writers are preferred over new readers, so they do not
+ *      starve. A read lock must be released by the thread that acquired it.
+ *      Not recursive: a reader acquiring the lock for reading a second time
+ *      can deadlock with a waiting writer.
+ */
+template<size_t slot_count = 32>
+struct biased_rwlock_traits {
+    struct alignas(64) reader_slot {
+        std::atomic<unsigned long>  readers_;
+    };
+
+    struct lock_t {
+        reader_slot                         slots_[slot_count];
+        /*!< Set while a writer holds, or is waiting for, the lock. */
+        alignas(64) std::atomic<bool>       writer_;
+        /*!< Serializes writers, and parks readers while a writer is active. */
+        futex_mutex_traits::lock_t          writer_lock_;
+    };
+
+    static size_t slot_index() {
+        static std::atomic<size_t> next_slot(0);
+        static thread_local size_t index =
+                next_slot.fetch_add(1, std::memory_order_relaxed) % slot_count;
+        return index;
+    }
+
+    static bool initialize(lock_t& lock) {
+        for (size_t i = 0; i < slot_count; ++i)
+            lock.slots_[i].readers_.store(0, std::memory_order_relaxed);
+        lock.writer_.store(false, std::memory_order_relaxed);
+        return futex_mutex_traits::initialize(lock.writer_lock_);
+    }
+
+    static void dispose(lock_t& lock) {
+        futex_mutex_traits::dispose(lock.writer_lock_);
+    }
+
+    static bool try_acquire_rd(lock_t& lock) {
+        std::atomic<unsigned long>& readers = lock.slots_[slot_index()].readers_;
+        // Sequentially consistent, as the writer side: either the writer sees
+        // this reader, or this reader sees the writer.
+        readers.fetch_add(1);
+        if (!lock.writer_.load())
+            return true;
+
+        readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    static void acquire_rd(lock_t& lock) {
+        while (!try_acquire_rd(lock)) {
+            // Wait for the writer to finish.
+            futex_mutex_traits::acquire(lock.writer_lock_);
+            futex_mutex_traits::release(lock.writer_lock_);
+        }
+    }
+
+    static void release_rd(lock_t& lock) {
+        lock.slots_[slot_index()].readers_.fetch_sub(1, std::memory_order_release);
+    }
+
+    static bool readers_present(lock_t& lock) {
+        for (size_t i = 0; i < slot_count; ++i)
+            if (lock.slots_[i].readers_.load() != 0)
+                return true;
+        return false;
+    }
+
+    static void acquire_wr(lock_t& lock) {
+        futex_mutex_traits::acquire(lock.writer_lock_);
+        lock.writer_.store(true);
+
+        spin_backoff backoff;
+        while (readers_present(lock))
+            backoff.wait();
+    }
+
+    static bool try_acquire_wr(lock_t& lock) {
+        if (!futex_mutex_traits::try_acquire(lock.writer_lock_))
+            return false;
+
+        lock.writer_.store(true);
+        if (!readers_present(lock))
+            return true;
+
+        release_wr(lock);
+        return false;
+    }
+
+    static void release_wr(lock_t& lock) {
+        lock.writer_.store(false, std::memory_order_release);
+        futex_mutex_traits::release(lock.writer_lock_);
+    }
+};
@@ -0,0 +1,84 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <thread>
+
+/**
+ * \brief Hint to the processor that the calling thread is spinning on a
+ *      contended location: frees pipeline resources for the other hardware
+ *      thread of the core, and avoids a memory order mis-speculation when
+ *      the spin loop exits.
+ */
+inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/**
+ * \brief Waiting policy for spin loops: pauses until a budget of pause
+ *      instructions is spent, then yields the processor on every round.
+ *      When there are more runnable threads than cores, the thread a spinner
+ *      waits for may have been preempted; yielding lets it run again,
+ *      instead of burning the rest of the spinner's time slice.
+ */
+class spin_backoff {
+private :
+    unsigned int    spent_;
+
+public :
+    enum {
+        /*!< Pause instructions executed before yielding. */
+        spin_budget = 512
+    };
+
+    spin_backoff() : spent_(0) {}
+
+    /**
+     * \brief Waits for one round.
+     * \param pauses Number of pause instructions in a round.
+     */
+    void wait(unsigned int pauses = 1) {
+        if (spent_ < spin_budget) {
+            spent_ += pauses;
+            for (unsigned int i = 0; i < pauses; ++i)
+                cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
@@ -0,0 +1,290 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+/**
+ * \brief Disposes of handles on a background thread. Handles are passed
+ *  through a bounded lock free queue (multiple producers, one consumer) to
+ *  a closer thread, which calls management_policy::dispose() on them. When
+ *  the queue is full, the handle is disposed of on the calling thread
+ *  instead, which bounds the number of handles waiting to be closed and
+ *  slows producers down to the pace of the closer thread.
+ * \remarks There is one closer per management policy and capacity, returned
+ *  by instance(). It is shut down during static destruction, after flushing
+ *  the queue; handles disposed of after that are closed inline.
+ * \see deferred_dispose
+ */
+template<typename management_policy, size_t capacity = 1024>
+class async_closer {
+public :
+    typedef management_policy                       mpolicy_t;
+    typedef typename mpolicy_t::handle_t            handle_t;
+
+    static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0,
+                  "Capacity must be a power of two!");
+
+private :
+    struct cell {
+        /*!< Ticket of the operation expected next on this cell. */
+        std::atomic<size_t>     sequence_;
+        handle_t                handle_;
+    };
+
+    /**
+     * \brief Shuts the closer down when the program exits.
+     */
+    struct shutdown_guard {
+        async_closer*   closer_;
+
+        explicit shutdown_guard(async_closer* closer) : closer_(closer) {}
+
+        ~shutdown_guard() {
+            closer_->shutdown();
+        }
+    };
+
+    cell                        cells_[capacity];
+    char                        head_pad_[64];
+    /*!< Next ticket for producers. */
+    std::atomic<size_t>         tail_;
+    char                        tail_pad_[64];
+    /*!< Next ticket to consume, closer thread only. */
+    size_t                      head_;
+
+    /*!< Producers currently in enqueue(). */
+    std::atomic<size_t>         producers_;
+    std::atomic<bool>           stopped_;
+    /*!< Set by the closer thread before it blocks. */
+    std::atomic<bool>           sleeping_;
+    /*!< Tickets below this value have been disposed of. */
+    std::atomic<size_t>         closed_;
+    /*!< Threads blocked in flush(). */
+    std::atomic<size_t>         flushers_;
+
+    std::mutex                  lock_;
+    /*!< Signals the closer thread; protected by lock_. */
+    bool                        wakeup_;
+    bool                        stop_;
+    std::condition_variable     work_available_;
+    std::condition_variable     flushed_;
+    std::thread                 thread_;
+
+    async_closer()
+        :       tail_(0),
+                head_(0),
+                producers_(0),
+                stopped_(false),
+                sleeping_(false),
+                closed_(0),
+                flushers_(0),
+                wakeup_(false),
+                stop_(false) {
+        for (size_t i = 0; i < capacity; ++i)
+            cells_[i].sequence_.store(i, std::memory_order_relaxed);
+        thread_ = std::thread(&async_closer::run, this);
+    }
+
+    async_closer(const async_closer&) = delete;
+    async_closer& operator=(const async_closer&) = delete;
+
+    bool push(handle_t handle) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        cell* target;
+        for (;;) {
+            target = &cells_[pos & (capacity - 1)];
+            const size_t sequence =
+                    target->sequence_.load(std::memory_order_acquire);
+            const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        target->handle_ = handle;
+        target->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(handle_t& handle) {
+        cell& target = cells_[head_ & (capacity - 1)];
+        if (target.sequence_.load(std::memory_order_acquire) != head_ + 1)
+            return false;
+
+        handle = target.handle_;
+        target.sequence_.store(head_ + capacity, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    bool empty() const {
+        return cells_[head_ & (capacity - 1)].sequence_.load(
+                    std::memory_order_acquire) != head_ + 1;
+    }
+
+    void wake_closer() {
+        std::lock_guard<std::mutex> guard(lock_);
+        wakeup_ = true;
+        work_available_.notify_one();
+    }
+
+    void run() {
+        for (;;) {
+            handle_t handle;
+            bool closed = false;
+            while (pop(handle)) {
+                mpolicy_t::dispose(handle);
+                closed = true;
+            }
+
+            if (closed) {
+                closed_.store(head_);
+                if (flushers_.load() != 0) {
+                    std::lock_guard<std::mutex> guard(lock_);
+                    flushed_.notify_all();
+                }
+            }
+
+            std::unique_lock<std::mutex> guard(lock_);
+            sleeping_.store(true);
+            // Pairs with the fence in enqueue(): either the producer sees
+            // sleeping_ set, or the closer sees the new element.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (empty()) {
+                if (stop_)
+                    break;
+                work_available_.wait(guard, [this]() {
+                    return wakeup_ || stop_;
+                });
+            }
+            wakeup_ = false;
+            sleeping_.store(false);
+        }
+    }
+
+    void shutdown() {
+        if (stopped_.exchange(true))
+            return;
+
+        // Producers that did not see the flag are done pushing afterwards.
+        while (producers_.load() != 0)
+            std::this_thread::yield();
+
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stop_ = true;
+            work_available_.notify_one();
+        }
+        thread_.join();
+    }
+
+public :
+    static async_closer& instance() {
+        static async_closer* closer = new async_closer();
+        static shutdown_guard guard(closer);
+        return *closer;
+    }
+
+    /**
+     * \brief Queues a handle for disposal, or disposes of it on the calling
+     *  thread if the queue is full or the closer has been shut down.
+     */
+    void enqueue(handle_t handle) {
+        producers_.fetch_add(1);
+        const bool queued = !stopped_.load() && push(handle);
+        producers_.fetch_sub(1);
+
+        if (!queued) {
+            mpolicy_t::dispose(handle);
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed))
+            wake_closer();
+    }
+
+    /**
+     * \brief Waits until the handles queued before the call are disposed of.
+     */
+    void flush() {
+        std::unique_lock<std::mutex> guard(lock_);
+        const size_t target = tail_.load();
+        if (closed_.load() >= target || stop_)
+            return;
+
+        flushers_.fetch_add(1);
+        wakeup_ = true;
+        work_available_.notify_one();
+        flushed_.wait(guard, [this, target]() {
+            return closed_.load() >= target || stop_;
+        });
+        flushers_.fetch_sub(1);
+    }
+};
+
+/**
+ * \brief Management policy wrapper that hands handles over to the
+ *  async_closer instead of disposing of them on the calling thread. Use it
+ *  for handles whose disposal may block, such as sockets with lingering data
+ *  or files on network filesystems, e.g.
+ *  scoped_handle<deferred_dispose<socket_policy> >.
+ * \remarks Errors reported by the disposal are lost, as with any dispose().
+ */
+template<typename management_policy, size_t capacity = 1024>
+struct deferred_dispose : public management_policy {
+    typedef async_closer<management_policy, capacity>   closer_t;
+    typedef typename management_policy::handle_t        handle_t;
+
+    static void dispose(handle_t handle) {
+        if (handle != management_policy::null_handle())
+            closer_t::instance().enqueue(handle);
+    }
+
+    /**
+     * \brief Waits for the disposal of the handles released so far.
+     */
+    static void flush() {
+        closer_t::instance().flush();
+    }
+};
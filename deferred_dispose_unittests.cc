@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "deferred_dispose.h"
+#include "scoped_handle.h"
+
+namespace {
+
+std::atomic<int> closed_on_closer(0);
+std::atomic<int> closed_inline(0);
+std::atomic<bool> closer_blocked(false);
+std::thread::id test_thread;
+
+struct slow_fd_policy : public handle_traits_base<int> {
+    static int null_handle() {
+        return -1;
+    }
+
+    static void dispose(int handle) {
+        if (handle == -1)
+            return;
+        if (std::this_thread::get_id() == test_thread) {
+            ++closed_inline;
+            return;
+        }
+        while (closer_blocked.load())
+            std::this_thread::yield();
+        ++closed_on_closer;
+    }
+};
+
+/**
+ * \brief Distinct policy type, to get a closer with its own small queue.
+ */
+struct small_queue_fd_policy : public slow_fd_policy {};
+
+} // anonymous namespace
+
+TEST(deferred_dispose, closes_on_background_thread) {
+    test_thread = std::this_thread::get_id();
+    closed_on_closer = 0;
+    closed_inline = 0;
+
+    typedef deferred_dispose<slow_fd_policy> policy_t;
+    for (int i = 0; i < 100; ++i)
+        scoped_handle<policy_t> handle(i);
+    { scoped_handle<policy_t> empty; }
+
+    policy_t::flush();
+    EXPECT_EQ(100, closed_on_closer);
+    EXPECT_EQ(0, closed_inline);
+}
+
+TEST(deferred_dispose, closes_inline_when_queue_is_full) {
+    test_thread = std::this_thread::get_id();
+    closed_on_closer = 0;
+    closed_inline = 0;
+
+    typedef deferred_dispose<small_queue_fd_policy, 4> policy_t;
+    closer_blocked = true;
+    for (int i = 0; i < 20; ++i)
+        scoped_handle<policy_t> handle(i);
+    // The closer holds at most one handle, plus 4 in the queue.
+    EXPECT_GE(closed_inline, 15);
+
+    closer_blocked = false;
+    policy_t::flush();
+    EXPECT_EQ(20, closed_on_closer + closed_inline);
+}
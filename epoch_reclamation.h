@@ -0,0 +1,331 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Epoch based reclamation domain. Allows readers to access objects
+ *      shared between threads without updating a reference count, by
+ *      deferring the destruction of retired objects until no reader can
+ *      still be accessing them.
+ *
+ *  Readers enclose their accesses in a critical section (see epoch_guard).
+ *  Entering a critical section publishes the current global epoch in a
+ *  record owned by the calling thread, so readers never write to a shared
+ *  cache line. Writers unlink an object so that new readers can no longer
+ *  find it, then retire it. The global epoch advances only when every
+ *  thread inside a critical section has observed it, and an object retired
+ *  in epoch e is destroyed once the global epoch reaches e + 2.
+ * \remarks There is a single domain per process, returned by instance().
+ *      Thread records are reused by new threads once their thread exits, and
+ *      objects retired by an exited thread are destroyed by the next thread
+ *      that takes over its record, or when the domain is destroyed.
+ * \see epoch_guard, epoch_storage
+ */
+class epoch_domain {
+private :
+    struct retired_object {
+        void*           ptr_;
+        void            (*deleter_)(void*);
+        unsigned long   epoch_;
+    };
+
+    /**
+     * \brief Per thread state. The published epoch is padded on both sides,
+     *      so that it does not share a cache line with other data (records
+     *      are allocated with new, which does not honour extended alignment
+     *      before C++17).
+     */
+    struct thread_record {
+        char                            leading_pad_[64];
+        /*!< Observed epoch shifted left by one, low bit set when active. */
+        std::atomic<unsigned long>      local_epoch_;
+        char                            trailing_pad_[
+                                            64 - sizeof(std::atomic<unsigned long>)];
+        std::atomic<bool>               in_use_;
+        /*!< Next record in the domain, never changes once published. */
+        thread_record*                  next_;
+        /*!< Critical section nesting depth, owner thread only. */
+        unsigned int                    nesting_;
+        /*!< Retire calls since the last reclamation attempt. */
+        unsigned int                    retired_since_scan_;
+        /*!< Objects waiting to be destroyed, owner thread only. */
+        std::vector<retired_object>     retired_;
+
+        thread_record()
+            :       local_epoch_(0), in_use_(true), next_(nullptr),
+                    nesting_(0), retired_since_scan_(0) {}
+    };
+
+    /**
+     * \brief Returns the thread record to the domain when a thread exits.
+     */
+    struct thread_record_holder {
+        thread_record*  record_;
+
+        thread_record_holder() : record_(nullptr) {}
+
+        ~thread_record_holder() {
+            if (record_)
+                instance().release_record(record_);
+        }
+    };
+
+    enum {
+        active_flag = 1,
+        /*!< Number of retired objects that triggers a reclamation attempt. */
+        scan_threshold = 64
+    };
+
+    alignas(64) std::atomic<unsigned long>  global_epoch_;
+    alignas(64) std::atomic<thread_record*> records_;
+
+    epoch_domain() : global_epoch_(1), records_(nullptr) {}
+
+    ~epoch_domain() {
+        thread_record* record = records_.load(std::memory_order_acquire);
+        while (record) {
+            thread_record* next = record->next_;
+            for (size_t i = 0; i < record->retired_.size(); ++i)
+                record->retired_[i].deleter_(record->retired_[i].ptr_);
+            delete record;
+            record = next;
+        }
+    }
+
+    static thread_record*& current_record() {
+        static thread_local thread_record* record = nullptr;
+        return record;
+    }
+
+    thread_record* record() {
+        thread_record*& record = current_record();
+        if (!record) {
+            static thread_local thread_record_holder holder;
+            record = acquire_record();
+            holder.record_ = record;
+        }
+        return record;
+    }
+
+    thread_record* acquire_record() {
+        for (thread_record* record = records_.load(std::memory_order_acquire);
+             record; record = record->next_) {
+            bool in_use = false;
+            if (!record->in_use_.load(std::memory_order_relaxed) &&
+                    record->in_use_.compare_exchange_strong(
+                        in_use, true, std::memory_order_acquire))
+                return record;
+        }
+
+        thread_record* record = new thread_record();
+        thread_record* head = records_.load(std::memory_order_relaxed);
+        do {
+            record->next_ = head;
+        } while (!records_.compare_exchange_weak(head, record,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+        return record;
+    }
+
+    void release_record(thread_record* record) {
+        try_advance();
+        reclaim(record);
+        record->local_epoch_.store(0, std::memory_order_release);
+        record->in_use_.store(false, std::memory_order_release);
+    }
+
+    /**
+     * \brief Advances the global epoch if every active thread has observed
+     *      the current one.
+     * \return True if the epoch was advanced, by this or another thread.
+     */
+    bool try_advance() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        unsigned long epoch = global_epoch_.load(std::memory_order_acquire);
+
+        for (thread_record* record = records_.load(std::memory_order_acquire);
+             record; record = record->next_) {
+            const unsigned long local =
+                    record->local_epoch_.load(std::memory_order_acquire);
+            if ((local & active_flag) && (local >> 1) != epoch)
+                return false;
+        }
+
+        global_epoch_.compare_exchange_strong(epoch, epoch + 1,
+                                              std::memory_order_acq_rel);
+        return true;
+    }
+
+    /**
+     * \brief Destroys the objects retired by a record at least two epochs
+     *      before the current one.
+     * \remarks Deleters may retire objects themselves (eg. an object that
+     *      owns an atomic_shared_pointer), which can run a nested reclaim().
+     *      The list is therefore moved out of the record before any deleter
+     *      runs, and the survivors are appended back afterwards.
+     */
+    void reclaim(thread_record* record) {
+        const unsigned long epoch =
+                global_epoch_.load(std::memory_order_acquire);
+        std::vector<retired_object> retired;
+        retired.swap(record->retired_);
+        record->retired_since_scan_ = 0;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch_ + 2 <= epoch)
+                retired[i].deleter_(retired[i].ptr_);
+            else
+                retired[kept++] = retired[i];
+        }
+        retired.resize(kept);
+
+        if (record->retired_.empty())
+            record->retired_.swap(retired);
+        else
+            record->retired_.insert(record->retired_.end(), retired.begin(),
+                                    retired.end());
+    }
+
+public :
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+
+    static epoch_domain& instance() {
+        static epoch_domain domain;
+        return domain;
+    }
+
+    /**
+     * \brief Enters a critical section. Objects retired after this call
+     *      will not be destroyed before the matching call to exit().
+     *      Critical sections may be nested.
+     */
+    void enter() {
+        thread_record* rec = record();
+        if (rec->nesting_++ == 0) {
+            rec->local_epoch_.store(
+                        (global_epoch_.load(std::memory_order_relaxed) << 1) |
+                        active_flag,
+                        std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    /**
+     * \brief Leaves a critical section.
+     */
+    void exit() {
+        thread_record* rec = current_record();
+        if (--rec->nesting_ == 0)
+            rec->local_epoch_.store(0, std::memory_order_release);
+    }
+
+    /**
+     * \brief Schedules an object for destruction, once all the threads that
+     *      are in a critical section have left it.
+     * \param ptr Object that is no longer reachable by new readers.
+     * \param deleter Function called with ptr to destroy the object.
+     */
+    void retire(void* ptr, void (*deleter)(void*)) {
+        thread_record* rec = record();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        retired_object retired = {
+            ptr, deleter, global_epoch_.load(std::memory_order_relaxed)
+        };
+        rec->retired_.push_back(retired);
+
+        if (++rec->retired_since_scan_ >= scan_threshold) {
+            try_advance();
+            reclaim(rec);
+        }
+    }
+
+    /**
+     * \brief Waits until all the objects retired by the calling thread have
+     *      been destroyed. Must not be called from inside a critical section.
+     */
+    void synchronize() {
+        thread_record* rec = record();
+        while (!rec->retired_.empty()) {
+            if (!try_advance())
+                std::this_thread::yield();
+            reclaim(rec);
+        }
+    }
+};
+
+/**
+ * \brief Helper class that keeps the calling thread in an epoch_domain
+ *      critical section for its lifetime.
+ * \see epoch_domain
+ */
+class epoch_guard {
+public :
+    epoch_guard() {
+        epoch_domain::instance().enter();
+    }
+
+    ~epoch_guard() {
+        epoch_domain::instance().exit();
+    }
+
+    epoch_guard(const epoch_guard&) = delete;
+    epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+/**
+ * \brief Storage policy that retires objects to the epoch_domain, instead of
+ *      destroying them immediately. The object is deleted once no thread
+ *      can still be reading it inside an epoch_guard.
+ * \see epoch_domain, epoch_guard
+ */
+template<typename T>
+struct epoch_storage {
+    static void dispose(T* ptr) {
+        if (ptr)
+            epoch_domain::instance().retire(ptr, &destroy);
+    }
+
+    enum {
+        is_array_ptr = 0
+    };
+
+private :
+    static void destroy(void* ptr) {
+        delete static_cast<T*>(ptr);
+    }
+};
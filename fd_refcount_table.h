@@ -0,0 +1,191 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * \brief Process wide table of reference counts, indexed by file descriptor.
+ *  Each slot holds the number of owners of a descriptor minus one, so that
+ *  a descriptor that was never shared needs no slot update at all, and a
+ *  slot is back to zero when its descriptor is closed and can be reused.
+ *  The table is split in chunks, allocated the first time a descriptor in
+ *  their range is shared and never released.
+ * \see fd_table_ownership
+ */
+class fd_refcount_table {
+private :
+    enum {
+        chunk_bits = 10,
+        chunk_size = 1 << chunk_bits,
+        /*!< Covers descriptors up to 4M. */
+        max_chunks = 4096
+    };
+
+    /*!< Zero initialized, since the table has static storage duration. */
+    std::atomic<std::atomic<int>*>  chunks_[max_chunks];
+
+    fd_refcount_table() {}
+
+    std::atomic<int>* allocate_chunk(size_t index) {
+        std::atomic<int>* chunk = new std::atomic<int>[chunk_size];
+        for (size_t i = 0; i < chunk_size; ++i)
+            chunk[i].store(0, std::memory_order_relaxed);
+
+        std::atomic<int>* expected = nullptr;
+        if (!chunks_[index].compare_exchange_strong(
+                    expected, chunk, std::memory_order_acq_rel,
+                    std::memory_order_acquire)) {
+            delete[] chunk;
+            return expected;
+        }
+        return chunk;
+    }
+
+public :
+    fd_refcount_table(const fd_refcount_table&) = delete;
+    fd_refcount_table& operator=(const fd_refcount_table&) = delete;
+
+    static fd_refcount_table& instance() {
+        static fd_refcount_table table;
+        return table;
+    }
+
+    /**
+     * \brief Returns the slot of a descriptor, allocating its chunk if needed.
+     */
+    std::atomic<int>& slot(int fd) {
+        const size_t index = static_cast<size_t>(fd) >> chunk_bits;
+        assert(index < max_chunks);
+
+        std::atomic<int>* chunk = chunks_[index].load(std::memory_order_acquire);
+        if (!chunk)
+            chunk = allocate_chunk(index);
+        return chunk[fd & (chunk_size - 1)];
+    }
+
+    /**
+     * \brief Returns the slot of a descriptor, or nullptr if no descriptor
+     *  in its range was ever shared.
+     */
+    std::atomic<int>* find(int fd) const {
+        const size_t index = static_cast<size_t>(fd) >> chunk_bits;
+        if (index >= max_chunks)
+            return nullptr;
+
+        std::atomic<int>* chunk = chunks_[index].load(std::memory_order_acquire);
+        return chunk ? &chunk[fd & (chunk_size - 1)] : nullptr;
+    }
+};
+
+/**
+ * \brief Ownership policy for shared_handle objects wrapping POSIX
+ *  descriptors. The number of owners is kept in the fd_refcount_table, so
+ *  the policy is stateless and a shared_handle using it is the size of the
+ *  descriptor itself. Copying or destroying a handle touches a single atomic
+ *  slot, and is safe across threads.
+ * \remarks Descriptors must be owned by a single group of shared_handle
+ *  objects, and closed only through them. Descriptors that are negative, or
+ *  equal to the null handle, are not counted.
+ * \see fd_refcount_table, shared_handle
+ */
+template<typename management_policy>
+class fd_table_ownership {
+public :
+    typedef typename management_policy::handle_t            handle_t;
+    typedef typename management_policy::handle_const_ref_t  handle_const_ref_t;
+    typedef fd_table_ownership<management_policy>           self_t;
+
+    static_assert(std::is_integral<handle_t>::value,
+                  "Handle type must be an integral descriptor!");
+
+private :
+    static bool is_counted(handle_const_ref_t h) {
+        return h >= 0 && h != management_policy::null_handle();
+    }
+
+public :
+    fd_table_ownership() {}
+
+    fd_table_ownership(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    void initialize(handle_const_ref_t) {}
+
+    void initialize_for_output() {}
+
+    void share(const self_t&, handle_const_ref_t h) {
+        if (is_counted(h))
+            fd_refcount_table::instance().slot(h).fetch_add(
+                        1, std::memory_order_relaxed);
+    }
+
+    bool release(handle_const_ref_t h) {
+        if (!is_counted(h))
+            return true;
+
+        std::atomic<int>* slot = fd_refcount_table::instance().find(h);
+        if (!slot)
+            return true;
+
+        //
+        // A zero slot means there are no other owners, and none can appear,
+        // since a new owner can only be created by copying an existing one.
+        int others = slot->load(std::memory_order_acquire);
+        while (others != 0) {
+            if (slot->compare_exchange_weak(others, others - 1,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire))
+                return false;
+        }
+        return true;
+    }
+
+    void steal(self_t&) {}
+
+    void swap(self_t&) {}
+
+    bool unique(handle_const_ref_t h) const {
+        return use_count(h) == 1;
+    }
+
+    size_t use_count(handle_const_ref_t h) const {
+        if (!is_counted(h))
+            return 1;
+
+        const std::atomic<int>* slot = fd_refcount_table::instance().find(h);
+        return slot ? slot->load(std::memory_order_relaxed) + 1 : 1;
+    }
+};
@@ -0,0 +1,340 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "cpu_relax.h"
+
+/**
+ * \brief Lock traits for a 4 byte mutex built on Linux futexes, usable with
+ *      scoped_lock and auto_lock. The lock word is 0 when unlocked, 1 when
+ *      locked, and 2 when locked with (possibly) sleeping waiters; acquiring
+ *      and releasing an uncontended lock is a single atomic operation,
+ *      without a system call.
+ *      Before sleeping, acquire() spins for a while, as long as the lock has
+ *      no sleeping waiters: the owner of a lock that others already sleep on
+ *      is unlikely to release it soon, so spinning is skipped.
+ * \remarks Process private, not recursive, no owner checking.
+ */
+struct futex_mutex_traits {
+    typedef std::atomic<uint32_t>   lock_t;
+
+    enum {
+        unlocked = 0,
+        locked = 1,
+        contended = 2,
+        /*!< Maximum number of pause instructions executed while spinning. */
+        spin_limit = 1024
+    };
+
+    static_assert(sizeof(lock_t) == 4, "The lock word must be 4 bytes!");
+
+    static int futex_wait(lock_t& word, uint32_t expected,
+                          const timespec* timeout = nullptr) {
+        return static_cast<int>(syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE,
+                                        expected, timeout, nullptr, 0));
+    }
+
+    static void futex_wake(lock_t& word, int count) {
+        syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    static bool initialize(lock_t& mtx) {
+        mtx.store(unlocked, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void dispose(lock_t&) {}
+
+    static bool try_acquire(lock_t& mtx) {
+        uint32_t expected = unlocked;
+        return mtx.compare_exchange_strong(expected, locked,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Spins with exponential backoff while the lock is held by a
+     *      thread nobody sleeps on.
+     * \return True if the lock was acquired while spinning.
+     */
+    static bool spin_acquire(lock_t& mtx) {
+        for (unsigned int pauses = 1; pauses <= spin_limit; pauses *= 2) {
+            const uint32_t state = mtx.load(std::memory_order_relaxed);
+            if (state == unlocked) {
+                if (try_acquire(mtx))
+                    return true;
+            } else if (state == contended) {
+                return false;
+            }
+            for (unsigned int i = 0; i < pauses; ++i)
+                cpu_relax();
+        }
+        return false;
+    }
+
+    static void acquire(lock_t& mtx) {
+        if (try_acquire(mtx) || spin_acquire(mtx))
+            return;
+
+        // From now on the lock is marked contended, even if this thread ends
+        // up being the only waiter: release() will then make one futex_wake
+        // call too many, which is harmless.
+        while (mtx.exchange(contended, std::memory_order_acquire) != unlocked)
+            futex_wait(mtx, contended);
+    }
+
+    /**
+     * \brief Tries to acquire the lock, waiting for at most timeout.
+     * \return True if the lock was acquired.
+     */
+    template<typename rep_t, typename period_t>
+    static bool try_acquire_for(
+            lock_t& mtx, const std::chrono::duration<rep_t, period_t>& timeout) {
+        if (try_acquire(mtx) || spin_acquire(mtx))
+            return true;
+
+        typedef std::chrono::steady_clock clock_t;
+        const clock_t::time_point deadline = clock_t::now() +
+                std::chrono::duration_cast<clock_t::duration>(timeout);
+
+        while (mtx.exchange(contended, std::memory_order_acquire) != unlocked) {
+            const std::chrono::nanoseconds remaining =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        deadline - clock_t::now());
+            if (remaining.count() <= 0)
+                return false;
+
+            timespec relative;
+            relative.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+            relative.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+            futex_wait(mtx, contended, &relative);
+        }
+        return true;
+    }
+
+    static void release(lock_t& mtx) {
+        if (mtx.fetch_sub(1, std::memory_order_release) != locked) {
+            mtx.store(unlocked, std::memory_order_release);
+            futex_wake(mtx, 1);
+        }
+    }
+};
+
+/**
+ * \brief Converts the time left until a deadline into a relative timespec.
+ * \return False if the deadline has passed.
+ */
+inline bool futex_timeout(std::chrono::steady_clock::time_point deadline,
+                          timespec& relative) {
+    const std::chrono::nanoseconds remaining =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0)
+        return false;
+    relative.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+    relative.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+    return true;
+}
+
+/**
+ * \brief Condition variable traits paired with futex_mutex_traits, usable
+ *      with scoped_condition. Waiters sleep on a sequence number that every
+ *      notification increments, so a notification sent after a waiter
+ *      released the mutex, but before it went to sleep, is not lost.
+ *      Notifying without waiters costs no system call: a waiter
+ *      increments waiters_ and then reads the sequence, a notifier
+ *      increments the sequence and then reads waiters_, all sequentially
+ *      consistent, so either the notifier sees the waiter, or the waiter
+ *      reads the new sequence and does not sleep. This holds even when the
+ *      notifier does not hold the mutex.
+ * \remarks Waiters woken by notify_all() all contend for the mutex, as there
+ *      is no requeueing onto the mutex word.
+ */
+struct futex_condition_traits {
+    typedef futex_mutex_traits  lock_traits_t;
+
+    struct cond_t {
+        futex_mutex_traits::lock_t  sequence_;
+        std::atomic<uint32_t>       waiters_;
+    };
+
+    static bool initialize(cond_t& cond) {
+        cond.sequence_.store(0, std::memory_order_relaxed);
+        cond.waiters_.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void dispose(cond_t&) {}
+
+    static void wait(cond_t& cond, lock_traits_t::lock_t& mtx) {
+        cond.waiters_.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t sequence = cond.sequence_.load(std::memory_order_seq_cst);
+        futex_mutex_traits::release(mtx);
+        futex_mutex_traits::futex_wait(cond.sequence_, sequence);
+        cond.waiters_.fetch_sub(1, std::memory_order_relaxed);
+        futex_mutex_traits::acquire(mtx);
+    }
+
+    /**
+     * \brief Waits until notified or until the deadline passes.
+     * \return False if the wait timed out.
+     */
+    static bool wait_until(cond_t& cond, lock_traits_t::lock_t& mtx,
+                           std::chrono::steady_clock::time_point deadline) {
+        timespec relative;
+        if (!futex_timeout(deadline, relative))
+            return false;
+
+        cond.waiters_.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t sequence = cond.sequence_.load(std::memory_order_seq_cst);
+        futex_mutex_traits::release(mtx);
+        const bool timed_out =
+                futex_mutex_traits::futex_wait(cond.sequence_, sequence,
+                                               &relative) == -1 &&
+                errno == ETIMEDOUT;
+        cond.waiters_.fetch_sub(1, std::memory_order_relaxed);
+        futex_mutex_traits::acquire(mtx);
+        return !timed_out;
+    }
+
+    static void notify_one(cond_t& cond) {
+        cond.sequence_.fetch_add(1, std::memory_order_seq_cst);
+        if (cond.waiters_.load(std::memory_order_seq_cst))
+            futex_mutex_traits::futex_wake(cond.sequence_, 1);
+    }
+
+    static void notify_all(cond_t& cond) {
+        cond.sequence_.fetch_add(1, std::memory_order_seq_cst);
+        if (cond.waiters_.load(std::memory_order_seq_cst))
+            futex_mutex_traits::futex_wake(cond.sequence_, INT_MAX);
+    }
+};
+
+/**
+ * \brief Event on a futex word. An auto-reset event lets a single waiter
+ *      through per set() and resets itself; a manual-reset event lets every
+ *      waiter through until reset() is called. set() and reset() make no
+ *      system call when nobody waits.
+ */
+class futex_event {
+private :
+    enum {
+        unsignaled = 0,
+        signaled = 1
+    };
+
+    futex_mutex_traits::lock_t  state_;
+    std::atomic<uint32_t>       waiters_;
+    const bool                  manual_reset_;
+
+    /**
+     * \brief Consumes the signal of an auto-reset event, checks the signal
+     *      of a manual-reset one.
+     */
+    bool try_consume() {
+        if (manual_reset_)
+            return state_.load(std::memory_order_acquire) == signaled;
+        uint32_t expected = signaled;
+        return state_.compare_exchange_strong(expected, unsignaled,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+public :
+    explicit futex_event(bool manual_reset = false, bool initially_set = false)
+        :       state_(initially_set ? signaled : unsignaled),
+                waiters_(0),
+                manual_reset_(manual_reset) {}
+
+    futex_event(const futex_event&) = delete;
+    futex_event& operator=(const futex_event&) = delete;
+
+    /**
+     * \brief Signals the event, waking one waiter (auto-reset) or all the
+     *      waiters (manual-reset).
+     */
+    void set() {
+        state_.store(signaled, std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_seq_cst))
+            futex_mutex_traits::futex_wake(state_, manual_reset_ ? INT_MAX : 1);
+    }
+
+    void reset() {
+        state_.store(unsignaled, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Returns at once, true if the event was signaled (and is now
+     *      reset, for an auto-reset event).
+     */
+    bool try_wait() {
+        return try_consume();
+    }
+
+    void wait() {
+        while (!try_consume()) {
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            futex_mutex_traits::futex_wait(state_, unsignaled);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * \brief Waits for the event for at most timeout.
+     * \return True if the event was signaled.
+     */
+    template<typename rep_t, typename period_t>
+    bool wait_for(const std::chrono::duration<rep_t, period_t>& timeout) {
+        const std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    timeout);
+        timespec relative;
+        while (!try_consume()) {
+            if (!futex_timeout(deadline, relative))
+                return false;
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            futex_mutex_traits::futex_wait(state_, unsignaled, &relative);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+};
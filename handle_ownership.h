@@ -0,0 +1,261 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * \brief Ownership policies for shared_handle. An ownership policy keeps
+ *  track of the shared_handle objects that refer to the same handle. It is
+ *  a base class of shared_handle, so a stateless policy adds nothing to
+ *  the size of a shared_handle object. A policy must define :
+ *  - initialize(h) which starts a new group of owners for the handle h.
+ *  - initialize_for_output() which starts a new group of owners for a
+ *      handle that is about to be written through shared_handle_get_impl().
+ *  - share(other, h) which joins the group of other, that owns h.
+ *  - release(h) which leaves the current group and returns true if this was
+ *      the last owner (in which case the handle is disposed of).
+ *  - steal(other) which takes the place of other in its group, leaving
+ *      other as the sole owner of a null handle.
+ *  - swap(other) which exchanges groups with other.
+ *  - unique(h) and use_count(h), which query the size of the group.
+ *\sa shared_handle
+ */
+
+/**
+ * \brief Keeps the owners of a handle in a circular doubly linked list. Each
+ *  node is part of a shared_handle object. Needs no allocation, but copying
+ *  or destroying a shared_handle writes into its neighbours, so shared_handle
+ *  objects referring to the same handle must not be used concurrently, and
+ *  use_count() is O(n).
+ */
+template<typename management_policy>
+class linked_ownership {
+public :
+    typedef typename management_policy::handle_const_ref_t  handle_const_ref_t;
+    typedef linked_ownership<management_policy>             self_t;
+
+private :
+    /**
+     * \brief Pointer to the next node in the list.
+     */
+    mutable self_t*     next_;
+    /**
+     * \brief Pointer to the previous node in the list.
+     */
+    mutable self_t*     prev_;
+
+    /**
+     * \brief Initialize by making a circular reference to this node.
+     */
+    void make_single() {
+        this->next_ = this->prev_ = this;
+    }
+
+    /**
+     * \brief Remove this node from the list of nodes that share
+     *  the same handle.
+     * \return True if this node is the only node in the list (in which case
+     *  the owned resource will be destructed when this object expires).
+     * \remarks The next_ and prev_ pointers are not updated, since erase()
+     *  is called either at the node's destruction or at assignment.
+     */
+    bool erase() {
+        this->prev_->next_ = this->next_;
+        this->next_->prev_ = this->prev_;
+        return (next_ == this) && (prev_ == this);
+    }
+
+public :
+    linked_ownership() {
+        make_single();
+    }
+
+    linked_ownership(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    void initialize(handle_const_ref_t) {
+        make_single();
+    }
+
+    void initialize_for_output() {
+        make_single();
+    }
+
+    /**
+     * \brief Adds this object to the list of objects that share the handle.
+     * \param other The previous node in the object list.
+     */
+    void share(const self_t& other, handle_const_ref_t) {
+        self_t* prev = const_cast<self_t*>(&other);
+        prev->next_->prev_ = this;
+        this->next_ = prev->next_;
+        prev->next_ = this;
+        this->prev_ = prev;
+    }
+
+    bool release(handle_const_ref_t) {
+        return erase();
+    }
+
+    /**
+     * \brief Replace other in its list.
+     */
+    void steal(self_t& other) {
+        //
+        // Replace the other node in the existing list. We save the next_
+        // pointer, since in the case when it points to other it becomes an
+        // alias for the this pointer, after the first assignment is executed.
+        self_t* tmpVal = other.next_;
+        //
+        // Replace the pointers to the nodes that where linked to other with
+        // pointers to ourselves.
+        other.prev_->next_ = this;
+        tmpVal->prev_ = this;
+
+        //
+        // Update our links and make other to refer to itself.
+        next_ = other.next_;
+        prev_ = other.prev_;
+        other.make_single();
+    }
+
+    void swap(self_t& other) {
+        //
+        // Save the next pointer, to avoid becoming an alias for &other.
+        // This happens when this node references itself.
+        self_t* saveRegOne = this->next_;
+        this->prev_->next_ = &other;
+        saveRegOne->prev_ = &other;
+
+        //
+        // See remarks for saveRegOne.
+        self_t* saveRegTwo = other.next_;
+        other.prev_->next_ = this;
+        saveRegTwo->prev_ = this;
+
+        //
+        // Save old links since we need them to fix the other node.
+        saveRegOne = this->prev_;
+        saveRegTwo = this->next_;
+
+        this->prev_ = other.prev_;
+        this->next_ = other.next_;
+
+        other.prev_ = saveRegOne;
+        other.next_ = saveRegTwo;
+    }
+
+    bool unique(handle_const_ref_t) const {
+        return (prev_ == this) && (next_ == this);
+    }
+
+    size_t use_count(handle_const_ref_t) const {
+        const self_t* head = next_;
+        size_t count = 1;
+        while (head != this) {
+            head = head->next_;
+            ++count;
+        }
+        return count;
+    }
+};
+
+/**
+ * \brief Keeps the number of owners of a handle in an atomic counter,
+ *  allocated when a valid handle is first owned. shared_handle objects
+ *  referring to the same handle can be copied and destroyed from different
+ *  threads, and use_count() is O(1). Null handles are not counted: each
+ *  shared_handle holding a null handle is its sole owner.
+ */
+template<typename management_policy>
+class counted_ownership {
+public :
+    typedef typename management_policy::handle_const_ref_t  handle_const_ref_t;
+    typedef counted_ownership<management_policy>            self_t;
+
+private :
+    /*!< Number of owners, or nullptr for a null handle. */
+    std::atomic<size_t>*    count_;
+
+public :
+    counted_ownership() : count_(nullptr) {}
+
+    counted_ownership(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    void initialize(handle_const_ref_t h) {
+        count_ = h == management_policy::null_handle() ?
+                    nullptr : new std::atomic<size_t>(1);
+    }
+
+    void initialize_for_output() {
+        count_ = new std::atomic<size_t>(1);
+    }
+
+    void share(const self_t& other, handle_const_ref_t) {
+        count_ = other.count_;
+        if (count_)
+            count_->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool release(handle_const_ref_t) {
+        if (!count_)
+            return true;
+
+        if (count_->fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return false;
+
+        delete count_;
+        count_ = nullptr;
+        return true;
+    }
+
+    void steal(self_t& other) {
+        count_ = other.count_;
+        other.count_ = nullptr;
+    }
+
+    void swap(self_t& other) {
+        std::swap(count_, other.count_);
+    }
+
+    bool unique(handle_const_ref_t) const {
+        return !count_ || count_->load(std::memory_order_relaxed) == 1;
+    }
+
+    size_t use_count(handle_const_ref_t) const {
+        return count_ ? count_->load(std::memory_order_relaxed) : 1;
+    }
+};
@@ -0,0 +1,465 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "scoped_handle.h"
+
+/**
+ * \brief Default recycling policy for handle_pool. Any non null handle is
+ *  reused as is.
+ */
+template<typename management_policy>
+struct default_recycling {
+    typedef typename management_policy::handle_t    handle_t;
+
+    /**
+     * \brief Returns true if the handle can be given out again.
+     */
+    static bool validate(handle_t handle) {
+        return handle != management_policy::null_handle();
+    }
+
+    /**
+     * \brief Brings a validated handle back to its initial state.
+     */
+    static void reset(handle_t) {}
+};
+
+template<typename management_policy, template<typename> class recycling_policy>
+class handle_pool;
+
+/**
+ * \brief A handle borrowed from a handle_pool. Behaves like a scoped_handle,
+ *  except that on destruction the handle is returned to the pool instead of
+ *  being disposed of.
+ * \see handle_pool
+ */
+template<
+        typename management_policy,
+        template<typename> class recycling_policy = default_recycling
+> class handle_lease {
+public :
+    typedef management_policy                               mpolicy_t;
+    typedef typename mpolicy_t::handle_t                    handle_t;
+    typedef handle_pool<management_policy, recycling_policy> pool_t;
+    typedef handle_lease<management_policy, recycling_policy> self_t;
+
+private :
+    friend class handle_pool<management_policy, recycling_policy>;
+
+    /*!< Pool the handle is returned to, nullptr for an empty lease. */
+    pool_t*     pool_;
+    /*!< Leased handle */
+    handle_t    handle_;
+    /*!< If set, the handle is disposed of instead of being recycled. */
+    bool        discard_;
+
+    struct helper_t {
+        int member;
+    };
+
+    handle_lease(pool_t* pool, handle_t handle)
+        : pool_(pool), handle_(handle), discard_(false) {}
+
+    void give_back() {
+        if (pool_) {
+            pool_->recycle(handle_, discard_);
+            pool_ = nullptr;
+            handle_ = mpolicy_t::null_handle();
+            discard_ = false;
+        }
+    }
+
+    handle_t detach() {
+        handle_t handle = handle_;
+        if (pool_)
+            pool_->detach();
+        pool_ = nullptr;
+        handle_ = mpolicy_t::null_handle();
+        discard_ = false;
+        return handle;
+    }
+
+public :
+    handle_lease()
+        : pool_(nullptr), handle_(mpolicy_t::null_handle()), discard_(false) {}
+
+    handle_lease(self_t&& right)
+        : pool_(right.pool_), handle_(right.handle_), discard_(right.discard_) {
+        right.pool_ = nullptr;
+        right.handle_ = mpolicy_t::null_handle();
+        right.discard_ = false;
+    }
+
+    handle_lease(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    ~handle_lease() {
+        give_back();
+    }
+
+    self_t& operator=(self_t&& right) {
+        if (this != &right) {
+            give_back();
+            std::swap(pool_, right.pool_);
+            std::swap(handle_, right.handle_);
+            std::swap(discard_, right.discard_);
+        }
+        return *this;
+    }
+
+    operator int helper_t::*() const {
+        return handle_ == mpolicy_t::null_handle() ? nullptr :
+            &helper_t::member;
+    }
+
+    bool operator!() const {
+        return handle_ == mpolicy_t::null_handle();
+    }
+
+    friend inline handle_t scoped_handle_get(const self_t& lease) {
+        return lease.handle_;
+    }
+
+    /**
+     * \brief Takes the handle out of the pool for good. The caller becomes
+     *  responsible for disposing of it.
+     */
+    friend inline handle_t scoped_handle_release(self_t& lease) {
+        return lease.detach();
+    }
+
+    /**
+     * \brief Returns the handle to the pool now, instead of on destruction.
+     */
+    friend inline void scoped_handle_reset(self_t& lease) {
+        lease.give_back();
+    }
+
+    /**
+     * \brief Marks the handle as broken: it will be disposed of, and not
+     *  recycled, when the lease ends.
+     */
+    friend inline void handle_lease_discard(self_t& lease) {
+        lease.discard_ = true;
+    }
+
+    friend inline void swap(self_t& left, self_t& right) {
+        std::swap(left.pool_, right.pool_);
+        std::swap(left.handle_, right.handle_);
+        std::swap(left.discard_, right.discard_);
+    }
+};
+
+/**
+ * \brief Bounded pool of reusable handles (sockets, files, ...). Handles
+ *  are created on demand by a factory function, up to the capacity of the
+ *  pool, and lent out as handle_lease objects. When a lease ends, the
+ *  handle goes through recycling_policy<management_policy>::validate() and
+ *  reset() and is kept for the next borrower; handles failing validation, or
+ *  discarded by their lease, are disposed of with the management policy.
+ *  When all the handles are in use, acquire() blocks until one is returned.
+ * \remarks Idle handles are kept in shards, each with its own lock. A thread
+ *  returns handles to, and looks for handles first in, the shard it maps to,
+ *  so that threads running on different cores mostly stay out of each
+ *  other's way, and a handle tends to be reused by the thread that last
+ *  used it. The pool must outlive its leases.
+ */
+template<
+        typename management_policy,
+        template<typename> class recycling_policy = default_recycling
+> class handle_pool {
+public :
+    typedef management_policy                               mpolicy_t;
+    typedef recycling_policy<management_policy>             rpolicy_t;
+    typedef typename mpolicy_t::handle_t                    handle_t;
+    typedef handle_lease<management_policy, recycling_policy> lease_t;
+    typedef std::function<handle_t ()>                      factory_t;
+
+private :
+    friend class handle_lease<management_policy, recycling_policy>;
+
+    /**
+     * \brief Idle handles, padded so that shards do not share cache lines.
+     */
+    struct shard {
+        char                    leading_pad_[64];
+        std::mutex              lock_;
+        std::vector<handle_t>   idle_;
+        char                    trailing_pad_[64];
+    };
+
+    /**
+     * \brief Counts the calling thread as a waiter until it leaves
+     *  wait_until(), including when the factory throws.
+     */
+    struct waiter_guard {
+        std::atomic<size_t>&    waiters_;
+
+        explicit waiter_guard(std::atomic<size_t>& waiters) : waiters_(waiters) {
+            ++waiters_;
+        }
+
+        ~waiter_guard() {
+            --waiters_;
+        }
+    };
+
+    factory_t                   factory_;
+    const size_t                capacity_;
+    const size_t                shard_count_;
+    shard*                      shards_;
+    /*!< Handles created and not yet disposed of, idle or leased. */
+    std::atomic<size_t>         live_;
+    /*!< Threads blocked in acquire. */
+    std::atomic<size_t>         waiters_;
+    std::mutex                  wait_lock_;
+    std::condition_variable     available_;
+    /*!< Bumped by every notification, guarded by wait_lock_. */
+    size_t                      wakeups_;
+
+    handle_pool(const handle_pool&) = delete;
+    handle_pool& operator=(const handle_pool&) = delete;
+
+    size_t home_shard() const {
+        static thread_local size_t hash =
+                std::hash<std::thread::id>()(std::this_thread::get_id());
+        return hash % shard_count_;
+    }
+
+    bool take_idle(handle_t& handle) {
+        const size_t home = home_shard();
+        for (size_t i = 0; i < shard_count_; ++i) {
+            shard& current = shards_[(home + i) % shard_count_];
+            std::lock_guard<std::mutex> guard(current.lock_);
+            if (!current.idle_.empty()) {
+                handle = current.idle_.back();
+                current.idle_.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * \brief Reserves room for a new handle and creates it.
+     * \return False if the pool is at capacity.
+     */
+    bool create(handle_t& handle) {
+        // Sequentially consistent, like the update in detach(), so that a
+        // waiter that finds the pool full cannot miss a handle going away.
+        size_t live = live_.load();
+        do {
+            if (live >= capacity_)
+                return false;
+        } while (!live_.compare_exchange_weak(live, live + 1));
+
+        try {
+            handle = factory_();
+        } catch (...) {
+            detach();
+            throw;
+        }
+
+        if (handle == mpolicy_t::null_handle())
+            detach();
+        return true;
+    }
+
+    /**
+     * \brief Non blocking attempt. An empty lease is returned if no handle
+     *  is idle and the pool is at capacity, or if the factory failed.
+     */
+    bool try_take(lease_t& lease) {
+        handle_t handle = mpolicy_t::null_handle();
+        if (take_idle(handle) || create(handle)) {
+            if (handle != mpolicy_t::null_handle())
+                lease = lease_t(this, handle);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * \brief Forgets about a handle that is no longer part of the pool.
+     */
+    void detach() {
+        live_.fetch_sub(1);
+        wake_waiter();
+    }
+
+    void wake_waiter() {
+        if (waiters_.load() != 0) {
+            std::lock_guard<std::mutex> guard(wait_lock_);
+            ++wakeups_;
+            available_.notify_one();
+        }
+    }
+
+    void recycle(handle_t handle, bool discard) {
+        if (discard || !rpolicy_t::validate(handle)) {
+            mpolicy_t::dispose(handle);
+            detach();
+            return;
+        }
+
+        rpolicy_t::reset(handle);
+        {
+            shard& home = shards_[home_shard()];
+            std::lock_guard<std::mutex> guard(home.lock_);
+            home.idle_.push_back(handle);
+        }
+        wake_waiter();
+    }
+
+    template<typename clock_t, typename duration_t>
+    lease_t wait_until(
+            const std::chrono::time_point<clock_t, duration_t>* deadline) {
+        lease_t lease;
+        if (try_take(lease))
+            return lease;
+
+        waiter_guard waiting(waiters_);
+        // The waiter count is published before looking at the pool again, so
+        // that a handle returned from now on is followed by a notification.
+        // try_take() may call the factory, so it runs without wait_lock_;
+        // the wakeup count read before it tells whether a handle was
+        // returned in the meantime.
+        for (;;) {
+            size_t seen;
+            {
+                std::lock_guard<std::mutex> guard(wait_lock_);
+                seen = wakeups_;
+            }
+            if (try_take(lease))
+                break;
+
+            std::unique_lock<std::mutex> guard(wait_lock_);
+            const auto notified = [this, seen]() { return wakeups_ != seen; };
+            if (!deadline) {
+                available_.wait(guard, notified);
+            } else if (!available_.wait_until(guard, *deadline, notified)) {
+                guard.unlock();
+                try_take(lease);
+                break;
+            }
+        }
+        return lease;
+    }
+
+public :
+    /**
+     * \brief Creates an empty pool.
+     * \param capacity Maximum number of handles, idle or leased.
+     * \param factory Creates a new handle, or returns the null handle on
+     *  failure.
+     * \param shards Number of shards for idle handles, by default the number
+     *  of hardware threads.
+     */
+    handle_pool(size_t capacity, factory_t factory, size_t shards = 0)
+        :       factory_(std::move(factory)),
+                capacity_(capacity),
+                shard_count_(shards ? shards :
+                             std::max(1u, std::thread::hardware_concurrency())),
+                shards_(new shard[shard_count_]),
+                live_(0),
+                waiters_(0),
+                wakeups_(0) {}
+
+    /**
+     * \brief Disposes of the idle handles. All leases must have ended.
+     */
+    ~handle_pool() {
+        size_t idle = 0;
+        for (size_t i = 0; i < shard_count_; ++i) {
+            for (size_t j = 0; j < shards_[i].idle_.size(); ++j)
+                mpolicy_t::dispose(shards_[i].idle_[j]);
+            idle += shards_[i].idle_.size();
+        }
+        assert(idle == live_.load());
+        (void) idle;
+        delete[] shards_;
+    }
+
+    /**
+     * \brief Borrows a handle, waiting for one to be returned if the pool is
+     *  exhausted. The lease is empty only if the factory failed.
+     */
+    lease_t acquire() {
+        return wait_until(
+                    static_cast<const std::chrono::steady_clock::time_point*>(
+                        nullptr));
+    }
+
+    /**
+     * \brief Borrows a handle if one is idle or can be created right away.
+     */
+    lease_t try_acquire() {
+        lease_t lease;
+        try_take(lease);
+        return lease;
+    }
+
+    /**
+     * \brief Borrows a handle, waiting at most timeout for one to be
+     *  returned. Returns an empty lease on timeout.
+     */
+    template<typename rep_t, typename period_t>
+    lease_t try_acquire_for(
+            const std::chrono::duration<rep_t, period_t>& timeout) {
+        const std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + timeout;
+        return wait_until(&deadline);
+    }
+
+    /**
+     * \brief Number of handles created and not disposed of.
+     */
+    size_t size() const {
+        return live_.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+};
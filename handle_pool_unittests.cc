@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "handle_pool.h"
+
+namespace {
+
+std::atomic<int> next_handle(0);
+std::atomic<int> disposed(0);
+
+struct counted_fd_policy : public handle_traits_base<int> {
+    static int null_handle() {
+        return -1;
+    }
+
+    static void dispose(int handle) {
+        if (handle != -1)
+            ++disposed;
+    }
+};
+
+/**
+ * \brief Rejects odd handles, to exercise the recycling hooks.
+ */
+template<typename management_policy>
+struct even_recycling {
+    static std::atomic<int> resets_;
+
+    static bool validate(int handle) {
+        return handle % 2 == 0;
+    }
+
+    static void reset(int) {
+        ++resets_;
+    }
+};
+
+template<typename management_policy>
+std::atomic<int> even_recycling<management_policy>::resets_(0);
+
+int open_fake_fd() {
+    return next_handle++;
+}
+
+typedef handle_pool<counted_fd_policy> fd_pool_t;
+
+} // anonymous namespace
+
+TEST(handle_pool, reuses_handles) {
+    next_handle = 0;
+    disposed = 0;
+    {
+        fd_pool_t pool(2, open_fake_fd);
+        int first;
+        {
+            fd_pool_t::lease_t lease = pool.acquire();
+            ASSERT_TRUE(lease);
+            first = scoped_handle_get(lease);
+        }
+        fd_pool_t::lease_t lease = pool.acquire();
+        EXPECT_EQ(first, scoped_handle_get(lease));
+        EXPECT_EQ(1u, pool.size());
+
+        fd_pool_t::lease_t second = pool.try_acquire();
+        EXPECT_TRUE(second);
+        EXPECT_EQ(2u, pool.size());
+
+        // At capacity.
+        EXPECT_TRUE(!pool.try_acquire());
+        EXPECT_TRUE(!pool.try_acquire_for(std::chrono::milliseconds(5)));
+
+        handle_lease_discard(second);
+        scoped_handle_reset(second);
+        EXPECT_EQ(1, disposed);
+        EXPECT_EQ(1u, pool.size());
+
+        int detached = scoped_handle_release(lease);
+        EXPECT_EQ(first, detached);
+        EXPECT_EQ(0u, pool.size());
+    }
+    EXPECT_EQ(1, disposed);
+}
+
+TEST(handle_pool, recycling_policy) {
+    next_handle = 0;
+    disposed = 0;
+    typedef handle_pool<counted_fd_policy, even_recycling> pool_t;
+    pool_t pool(4, open_fake_fd, 1);
+    {
+        pool_t::lease_t even = pool.acquire();
+        pool_t::lease_t odd = pool.acquire();
+        EXPECT_EQ(0, scoped_handle_get(even));
+        EXPECT_EQ(1, scoped_handle_get(odd));
+    }
+    EXPECT_EQ(1, disposed);
+    EXPECT_EQ(1, even_recycling<counted_fd_policy>::resets_.load());
+    EXPECT_EQ(1u, pool.size());
+}
+
+TEST(handle_pool, blocking_acquire) {
+    next_handle = 0;
+    fd_pool_t pool(2, open_fake_fd);
+    std::atomic<int> in_use(0);
+    std::atomic<bool> overflow(false);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.push_back(std::thread([&pool, &in_use, &overflow]() {
+            for (int j = 0; j < 500; ++j) {
+                fd_pool_t::lease_t lease = pool.acquire();
+                if (++in_use > 2)
+                    overflow = true;
+                --in_use;
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    EXPECT_FALSE(overflow);
+    EXPECT_LE(pool.size(), 2u);
+}
+
+TEST(handle_pool, factory_runs_without_wait_lock) {
+    next_handle = 0;
+    disposed = 0;
+    fd_pool_t::lease_t* evicted = nullptr;
+
+    // Returning a lease from inside the factory notifies the waiters, which
+    // must not deadlock with the waiter that is running the factory.
+    fd_pool_t pool(2, [&evicted]() {
+        if (evicted)
+            scoped_handle_reset(*evicted);
+        return open_fake_fd();
+    });
+    fd_pool_t::lease_t first = pool.acquire();
+    fd_pool_t::lease_t second = pool.acquire();
+    evicted = &second;
+
+    bool acquired = false;
+    std::thread waiter([&pool, &acquired]() {
+        fd_pool_t::lease_t lease = pool.acquire();
+        acquired = lease;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    handle_lease_discard(first);
+    scoped_handle_reset(first);
+    waiter.join();
+
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(1, disposed);
+}
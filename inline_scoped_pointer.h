@@ -0,0 +1,432 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "pointer_policies.h"
+
+/**
+ * \brief Allocates the objects of an inline_scoped_ptr that do not fit inline
+ *  (or leave the buffer), so that storage_policy<T>::dispose() can release
+ *  them: with new for default_storage, with storage_policy<U>::create() for
+ *  policies that have one, such as pooled_storage. Other policies (eg.
+ *  arena_storage, which does not own memory) are rejected at compile time.
+ */
+template<template<typename> class storage_policy>
+struct inline_heap_allocator {
+private :
+    template<typename P>
+    static std::true_type has_create(decltype(&P::template create<>)*);
+
+    template<typename>
+    static std::false_type has_create(...);
+
+    template<typename U, typename... Args>
+    static U* allocate(std::true_type, Args&&... args) {
+        return new U(std::forward<Args>(args)...);
+    }
+
+    template<typename U, typename... Args>
+    static U* allocate(std::false_type, Args&&... args) {
+        return storage_policy<U>::create(std::forward<Args>(args)...);
+    }
+
+public :
+    template<typename T>
+    struct supports {
+        enum {
+            value = std::is_same<storage_policy<T>, default_storage<T> >::value ||
+                    decltype(has_create<storage_policy<T> >(nullptr))::value
+        };
+    };
+
+    template<typename U, typename... Args>
+    static U* create(Args&&... args) {
+        return allocate<U>(std::is_same<storage_policy<U>, default_storage<U> >(),
+                           std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * \brief Type erased operations on an object stored inside the buffer of an
+ *  inline_scoped_ptr. One static table exists per stored type and storage
+ *  policy.
+ */
+struct inline_object_ops {
+    /*!< Size of the stored type. */
+    size_t  size_;
+    /*!< Alignment of the stored type. */
+    size_t  alignment_;
+    /*!< Move constructs the object at dst from the one at src, then destroys
+     *   the one at src. */
+    void    (*move_)(void* dst, void* src);
+    /*!< Destroys the object. */
+    void    (*destroy_)(void* obj);
+    /*!< Moves the object to a heap allocation made with
+     *   inline_heap_allocator, and destroys the original. Returns the new
+     *   object. */
+    void*   (*relocate_)(void* src);
+};
+
+template<typename U, template<typename> class storage_policy>
+struct inline_object_ops_for {
+    static void move(void* dst, void* src) {
+        U* source = static_cast<U*>(src);
+        new (dst) U(std::move(*source));
+        source->~U();
+    }
+
+    static void destroy(void* obj) {
+        static_cast<U*>(obj)->~U();
+    }
+
+    static void* relocate(void* src) {
+        U* source = static_cast<U*>(src);
+        U* moved = inline_heap_allocator<storage_policy>::template create<U>(
+                    std::move(*source));
+        source->~U();
+        return moved;
+    }
+
+    static const inline_object_ops table;
+};
+
+template<typename U, template<typename> class storage_policy>
+const inline_object_ops inline_object_ops_for<U, storage_policy>::table = {
+    sizeof(U),
+    alignof(U),
+    &inline_object_ops_for<U, storage_policy>::move,
+    &inline_object_ops_for<U, storage_policy>::destroy,
+    &inline_object_ops_for<U, storage_policy>::relocate
+};
+
+/**
+ * \brief A unique owning smart pointer with the scoped_ptr interface, that
+ *  stores objects created with emplace() in an inline buffer of N bytes,
+ *  when they fit and can be moved without throwing. Larger objects are
+ *  allocated through the storage policy (see inline_heap_allocator) and,
+ *  like pointers adopted through the constructor or scoped_pointer_reset(),
+ *  released with the storage_policy<T> policy.
+ *  Objects stored inline are destroyed through their own type, so T does not
+ *  need a virtual destructor for them.
+ * \remarks Moving the owner moves the inline object to the new buffer, so
+ *  pointers to an inline object are invalidated when the owner is moved.
+ *  scoped_pointer_release() on an inline object moves it to the heap first,
+ *  through the storage policy. Only default_storage and policies with a
+ *  create() function, such as pooled_storage, are supported.
+ * \see scoped_ptr
+ */
+template<
+        typename T,
+        size_t N = 4 * sizeof(void*),
+        template<typename> class storage_policy = default_storage,
+        template<typename> class checking_policy = assert_check
+> class inline_scoped_ptr {
+public :
+    typedef storage_policy<T>                                       spolicy_t;
+    typedef checking_policy<T>                                      checkpolicy_t;
+    typedef inline_scoped_ptr<T, N, storage_policy, checking_policy> self_t;
+    typedef T*                                                      pointer_t;
+    typedef const T*                                                const_pointer_t;
+    typedef T&                                                      ref_t;
+    typedef const T&                                                const_ref_t;
+
+    enum {
+        inline_size = N,
+        inline_alignment = alignof(std::max_align_t)
+    };
+
+    static_assert(inline_heap_allocator<storage_policy>::template supports<T>::value,
+                  "The storage policy must be default_storage or have create()!");
+
+private :
+    template<typename, size_t, template<typename> class,
+             template<typename> class> friend class inline_scoped_ptr;
+
+    /*!< Storage for an inline object. */
+    alignas(std::max_align_t) unsigned char buffer_[N];
+    /*!< Owned object, either inside buffer_ or on the heap. */
+    T*                                      pointee_;
+    /*!< Operations on the inline object, nullptr if it is on the heap. */
+    const inline_object_ops*                ops_;
+
+    struct helper_t {
+        int member;
+    };
+
+    template<typename U>
+    struct fits_inline {
+        enum {
+            value = sizeof(U) <= N &&
+                    alignof(U) <= inline_alignment &&
+                    std::is_nothrow_move_constructible<U>::value
+        };
+    };
+
+    template<typename U, typename... Args>
+    U* construct(std::true_type, Args&&... args) {
+        U* obj = new (buffer_) U(std::forward<Args>(args)...);
+        ops_ = &inline_object_ops_for<U, storage_policy>::table;
+        return obj;
+    }
+
+    template<typename U, typename... Args>
+    U* construct(std::false_type, Args&&... args) {
+        return inline_heap_allocator<storage_policy>::template create<U>(
+                    std::forward<Args>(args)...);
+    }
+
+    T* get() const {
+        checkpolicy_t::check_ptr(pointee_);
+        return pointee_;
+    }
+
+    /**
+     * \brief Offset of the owned T subobject within the inline object.
+     */
+    size_t pointee_offset() const {
+        return reinterpret_cast<const unsigned char*>(pointee_) - buffer_;
+    }
+
+    T* release() {
+        T* old_val = pointee_;
+        if (ops_) {
+            unsigned char* moved =
+                    static_cast<unsigned char*>(ops_->relocate_(buffer_));
+            old_val = reinterpret_cast<T*>(moved + pointee_offset());
+            ops_ = nullptr;
+        }
+        pointee_ = nullptr;
+        return old_val;
+    }
+
+    void clear() {
+        if (ops_) {
+            ops_->destroy_(buffer_);
+            ops_ = nullptr;
+        } else {
+            spolicy_t::dispose(pointee_);
+        }
+        pointee_ = nullptr;
+    }
+
+    void reset(T* other) {
+        if (pointee_ != other) {
+            clear();
+            pointee_ = other;
+        }
+    }
+
+    /**
+     * \brief Takes over the object owned by other, which must not own
+     *  anything else than this object does.
+     */
+    template<typename U, size_t M>
+    void steal(inline_scoped_ptr<U, M, storage_policy, checking_policy>& other) {
+        if (!other.ops_) {
+            pointee_ = other.pointee_;
+        } else if (other.ops_->size_ <= N &&
+                   other.ops_->alignment_ <= inline_alignment) {
+            const size_t offset = other.pointee_offset();
+            other.ops_->move_(buffer_, other.buffer_);
+            pointee_ = reinterpret_cast<U*>(buffer_ + offset);
+            ops_ = other.ops_;
+        } else {
+            pointee_ = other.release();
+        }
+        other.pointee_ = nullptr;
+        other.ops_ = nullptr;
+    }
+
+public :
+    /**
+     * \brief Default initialize using the null pointer.
+     */
+    inline_scoped_ptr() : pointee_(nullptr), ops_(nullptr) {}
+
+    /**
+     * \brief Adopts a heap allocated object, to be released with the storage
+     *  policy.
+     */
+    explicit inline_scoped_ptr(T* ptr) : pointee_(ptr), ops_(nullptr) {}
+
+    inline_scoped_ptr(self_t&& right) : pointee_(nullptr), ops_(nullptr) {
+        steal(right);
+    }
+
+    /**
+     * \brief Construct from an rvalue object with a convertible pointer type.
+     */
+    template<typename U, size_t M>
+    inline_scoped_ptr(
+            inline_scoped_ptr<U, M, storage_policy, checking_policy>&& right)
+        : pointee_(nullptr), ops_(nullptr) {
+        steal(right);
+    }
+
+    ~inline_scoped_ptr() {
+        clear();
+    }
+
+    inline_scoped_ptr(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    self_t& operator=(self_t&& right) {
+        if (this != &right) {
+            clear();
+            steal(right);
+        }
+        return *this;
+    }
+
+    template<typename U, size_t M>
+    self_t& operator=(
+            inline_scoped_ptr<U, M, storage_policy, checking_policy>&& right
+            )
+    {
+        clear();
+        steal(right);
+        return *this;
+    }
+
+    /**
+     * \brief Destroys the owned object and constructs a new object of type U
+     *  (T by default) from args, inline if it fits, on the heap otherwise.
+     * \return Reference to the new object.
+     */
+    template<typename U = T, typename... Args>
+    U& emplace(Args&&... args) {
+        static_assert(std::is_convertible<U*, T*>::value,
+                      "U must be T or derived from T!");
+        clear();
+        U* obj = construct<U>(
+                    std::integral_constant<bool, fits_inline<U>::value>(),
+                    std::forward<Args>(args)...);
+        pointee_ = obj;
+        return *obj;
+    }
+
+    /**
+     * \brief Test if the owned pointer is null.
+     */
+    bool operator!() const {
+        return pointee_ == nullptr;
+    }
+
+    /**
+     * \brief Test if the owned pointer is not null.
+     */
+    operator int helper_t::*() const {
+        return pointee_ == nullptr ? nullptr : &helper_t::member;
+    }
+
+    T*  operator->() const {
+        checkpolicy_t::check_ptr(pointee_);
+        return pointee_;
+    }
+
+    T&  operator*() {
+        checkpolicy_t::check_ptr(pointee_);
+        return *pointee_;
+    }
+
+    const T& operator*() const {
+        checkpolicy_t::check_ptr(pointee_);
+        return *pointee_;
+    }
+
+    /**
+     * \brief Explicit access to the owned pointer.
+     */
+    friend inline T* scoped_pointer_get(const self_t& sp) {
+        return sp.get();
+    }
+
+    /**
+     * \brief Releases ownership of the object to the caller. An inline object
+     *  is moved to a heap allocation first.
+     */
+    friend inline T* scoped_pointer_release(self_t& sp) {
+        return sp.release();
+    }
+
+    /**
+     * \brief Destroys the owned object and adopts other, which must have been
+     *  allocated in a way compatible with the storage policy.
+     */
+    friend inline void scoped_pointer_reset(self_t& sp, T* other = nullptr) {
+        sp.reset(other);
+    }
+
+    /**
+     * \brief Test if the owned object is stored in the inline buffer.
+     */
+    friend inline bool inline_scoped_ptr_is_inline(const self_t& sp) {
+        return sp.ops_ != nullptr;
+    }
+
+    /**
+     * \brief Swap contents with another inline_scoped_ptr object.
+     */
+    friend inline void swap(self_t& left, self_t& right) {
+        self_t temp(std::move(left));
+        left = std::move(right);
+        right = std::move(temp);
+    }
+};
+
+template<typename T, size_t N, template<typename> class U,
+         template<typename> class W>
+inline bool operator==(const T* left, inline_scoped_ptr<T, N, U, W>& right) {
+    return left == scoped_pointer_get(right);
+}
+
+template<typename T, size_t N, template<typename> class U,
+         template<typename> class W>
+inline bool operator!=(const T* left, inline_scoped_ptr<T, N, U, W>& right) {
+    return !(left == right);
+}
+
+template<typename T, size_t N, template<typename> class U,
+         template<typename> class W>
+inline bool operator==(inline_scoped_ptr<T, N, U, W>& left, const T* right) {
+    return right == left;
+}
+
+template<typename T, size_t N, template<typename> class U,
+         template<typename> class W>
+inline bool operator!=(inline_scoped_ptr<T, N, U, W>& left, const T* right) {
+    return !(right == left);
+}
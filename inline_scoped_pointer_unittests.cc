@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "inline_scoped_pointer.h"
+#include "memory_pool.h"
+#include "monotonic_arena.h"
+
+struct shape {
+    static int alive_;
+
+    shape() {
+        ++alive_;
+    }
+
+    shape(const shape&) noexcept {
+        ++alive_;
+    }
+
+    virtual ~shape() {
+        --alive_;
+    }
+
+    virtual double area() const = 0;
+};
+
+int shape::alive_ = 0;
+
+struct square : public shape {
+    double side_;
+
+    explicit square(double side) : side_(side) {}
+
+    double area() const {
+        return side_ * side_;
+    }
+};
+
+struct polygon : public shape {
+    double points_[32];
+
+    polygon() {
+        for (int i = 0; i < 32; ++i)
+            points_[i] = 1.0;
+    }
+
+    double area() const {
+        return points_[31];
+    }
+};
+
+typedef inline_scoped_ptr<shape, 32> shape_ptr_t;
+
+TEST(inline_scoped_ptr, inline_and_heap_objects) {
+    {
+        shape_ptr_t small;
+        EXPECT_TRUE(!small);
+        small.emplace<square>(3.0);
+        EXPECT_TRUE(inline_scoped_ptr_is_inline(small));
+        EXPECT_DOUBLE_EQ(9.0, small->area());
+
+        shape_ptr_t large;
+        large.emplace<polygon>();
+        EXPECT_FALSE(inline_scoped_ptr_is_inline(large));
+        EXPECT_DOUBLE_EQ(1.0, (*large).area());
+
+        shape_ptr_t adopted(new square(2.0));
+        EXPECT_FALSE(inline_scoped_ptr_is_inline(adopted));
+        EXPECT_TRUE(adopted);
+        EXPECT_EQ(3, shape::alive_);
+    }
+    EXPECT_EQ(0, shape::alive_);
+}
+
+TEST(inline_scoped_ptr, move_and_swap) {
+    {
+        shape_ptr_t first;
+        first.emplace<square>(2.0);
+
+        shape_ptr_t second(std::move(first));
+        EXPECT_TRUE(!first);
+        EXPECT_TRUE(inline_scoped_ptr_is_inline(second));
+        EXPECT_DOUBLE_EQ(4.0, second->area());
+
+        shape_ptr_t third;
+        third.emplace<polygon>();
+        swap(second, third);
+        EXPECT_DOUBLE_EQ(1.0, second->area());
+        EXPECT_DOUBLE_EQ(4.0, third->area());
+        EXPECT_EQ(2, shape::alive_);
+
+        // Too small to hold a square, moves it to the heap.
+        inline_scoped_ptr<shape, 8> narrow(std::move(third));
+        EXPECT_FALSE(inline_scoped_ptr_is_inline(narrow));
+        EXPECT_DOUBLE_EQ(4.0, narrow->area());
+    }
+    EXPECT_EQ(0, shape::alive_);
+}
+
+TEST(inline_scoped_ptr, release_and_reset) {
+    shape_ptr_t ptr;
+    ptr.emplace<square>(5.0);
+
+    shape* released = scoped_pointer_release(ptr);
+    EXPECT_TRUE(!ptr);
+    EXPECT_DOUBLE_EQ(25.0, released->area());
+
+    scoped_pointer_reset(ptr, released);
+    EXPECT_TRUE(released == ptr);
+    scoped_pointer_reset(ptr);
+    EXPECT_EQ(0, shape::alive_);
+
+    inline_scoped_ptr<std::string> text;
+    text.emplace("inline");
+    EXPECT_EQ("inline", *text);
+}
+
+TEST(inline_scoped_ptr, heap_objects_use_the_storage_policy) {
+    typedef inline_scoped_ptr<shape, 32, pooled_storage> pooled_shape_ptr_t;
+    static_assert(!inline_heap_allocator<arena_storage>::supports<shape>::value,
+                  "arena_storage cannot allocate the heap fallback");
+    {
+        pooled_shape_ptr_t large;
+        large.emplace<polygon>();
+        EXPECT_FALSE(inline_scoped_ptr_is_inline(large));
+        EXPECT_DOUBLE_EQ(1.0, large->area());
+
+        pooled_shape_ptr_t small;
+        small.emplace<square>(2.0);
+        EXPECT_TRUE(inline_scoped_ptr_is_inline(small));
+
+        // Moved out of the buffer with pooled_storage<square>::create(), so
+        // that pooled_storage<shape>::dispose() can release it.
+        shape* released = scoped_pointer_release(small);
+        EXPECT_DOUBLE_EQ(4.0, released->area());
+        pooled_storage<shape>::dispose(released);
+
+        // Does not fit the smaller buffer, moves to the pool.
+        pooled_shape_ptr_t wide;
+        wide.emplace<square>(3.0);
+        inline_scoped_ptr<shape, 8, pooled_storage> narrow(std::move(wide));
+        EXPECT_FALSE(inline_scoped_ptr_is_inline(narrow));
+        EXPECT_DOUBLE_EQ(9.0, narrow->area());
+    }
+    EXPECT_EQ(0, shape::alive_);
+}
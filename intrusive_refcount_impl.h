@@ -31,6 +31,9 @@
 
 #pragma once
 
+#include <atomic>
+#include "shared_control_block.h"
+
 /**
  * \brief Helper class, to add intrusive reference counting to an existing
  *      class, so that objects of those class can be used in conjunction
@@ -54,3 +57,93 @@ public :
         return --refcount_ == 0;
     }
 };
+
+/**
+ * \brief Thread safe counterpart of intrusive_refcount_impl. The reference
+ *      count is kept in an atomic variable, so that shared_pointer objects
+ *      referring to the same object can be copied and destroyed from
+ *      different threads.
+ * \remarks Incrementing the count uses relaxed ordering, since a new
+ *      reference can only be created from an existing one, which already
+ *      keeps the object alive. Decrementing uses release ordering, so that
+ *      all the writes made through a reference happen before the object is
+ *      destroyed, and the thread that drops the last reference issues an
+ *      acquire fence before returning true.
+ * \see shared_pointer, atomic_intrusive_refcount
+ */
+class atomic_intrusive_refcount_impl {
+private :
+    mutable std::atomic<unsigned int>   refcount_;
+
+protected :
+    atomic_intrusive_refcount_impl() : refcount_(1) {}
+
+    ~atomic_intrusive_refcount_impl() {}
+
+public :
+    atomic_intrusive_refcount_impl(
+            const atomic_intrusive_refcount_impl&) = delete;
+    atomic_intrusive_refcount_impl& operator=(
+            const atomic_intrusive_refcount_impl&) = delete;
+
+    void add_ref() const {
+        refcount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool dec_ref() const {
+        if (refcount_.fetch_sub(1, std::memory_order_release) != 1)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    /**
+     * \brief Returns the current number of references. The value may be
+     *      stale by the time it is used if other threads hold references.
+     */
+    unsigned int use_count() const {
+        return refcount_.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * \brief Thread safe intrusive reference counting, with support for
+ *      weak_pointer objects. The counts are kept in a shared_control_block
+ *      allocated by the constructor, which outlives the object while weak
+ *      references to it exist.
+ * \see shared_pointer, weak_pointer, weak_intrusive_refcount
+ */
+class weak_intrusive_refcount_impl {
+private :
+    shared_control_block*   counts_;
+
+protected :
+    weak_intrusive_refcount_impl()
+        : counts_(shared_control_block::allocate_detached()) {}
+
+    ~weak_intrusive_refcount_impl() {
+        counts_->release_weak_ref();
+    }
+
+public :
+    weak_intrusive_refcount_impl(const weak_intrusive_refcount_impl&) = delete;
+    weak_intrusive_refcount_impl& operator=(
+            const weak_intrusive_refcount_impl&) = delete;
+
+    void add_ref() const {
+        counts_->strong_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool dec_ref() const {
+        if (counts_->strong_.fetch_sub(1, std::memory_order_release) != 1)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    shared_control_block* control_block() const {
+        return counts_;
+    }
+};
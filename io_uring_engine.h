@@ -0,0 +1,622 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <system_error>
+#include <utility>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "shared_handle.h"
+
+/**
+ * \brief Index of a file registered with io_uring_engine::register_files().
+ *  The kernel holds its own reference to registered files, so operations
+ *  on them do not depend on the lifetime of the handle they came from.
+ */
+struct registered_file {
+    unsigned int    index_;
+
+    explicit registered_file(unsigned int index) : index_(index) {}
+};
+
+/**
+ * \brief Asynchronous I/O on file descriptors and sockets, using io_uring
+ *  through raw system calls.
+ *
+ *  Operations are prepared in the submission ring without any system call
+ *  and submitted in one batch by submit(), or implicitly when the ring is
+ *  full. Completions are reaped by run(), which invokes the callback of each
+ *  completed operation with its result: the number of bytes transferred
+ *  (0 for fsync), or -errno on failure.
+ *
+ *  Operations on a shared_handle keep a copy of the handle until their
+ *  callback has run, so the descriptor cannot be closed while the kernel
+ *  works on it. For descriptors owned by a scoped_handle, register them with
+ *  register_files() and use the registered_file overloads.
+ * \remarks The engine is not thread safe: one thread prepares, submits and
+ *  reaps operations. The same applies to the shared_handle copies it keeps,
+ *  unless they use counted_ownership. Buffers and iovec arrays must stay
+ *  valid until the operation completes. Operations still in flight when the
+ *  engine is destroyed are cancelled, and the destructor waits for the
+ *  kernel to acknowledge them; their callbacks are not run.
+ */
+class io_uring_engine {
+public :
+    typedef std::function<void (int)>   callback_t;
+
+private :
+    /**
+     * \brief Bookkeeping for an operation in flight. The address of the
+     *  record is the user data of the submission entry.
+     */
+    struct operation {
+        callback_t  callback_;
+        operation*  prev_;
+        operation*  next_;
+        bool        cancelling_;
+    };
+
+    int                         ring_fd_;
+    unsigned int                features_;
+
+    void*                       sq_ring_;
+    size_t                      sq_ring_size_;
+    void*                       cq_ring_;
+    size_t                      cq_ring_size_;
+    io_uring_sqe*               sqes_;
+    size_t                      sqes_size_;
+
+    std::atomic<unsigned int>*  sq_head_;
+    std::atomic<unsigned int>*  sq_tail_;
+    unsigned int                sq_mask_;
+    unsigned int                sq_entries_;
+    unsigned int*               sq_array_;
+    /*!< Tail including prepared entries not yet made visible to the kernel. */
+    unsigned int                sq_local_tail_;
+    /*!< Entries made visible to the kernel but not consumed by io_uring_enter. */
+    unsigned int                to_submit_;
+
+    std::atomic<unsigned int>*  cq_head_;
+    std::atomic<unsigned int>*  cq_tail_;
+    unsigned int                cq_mask_;
+    unsigned int                cq_entries_;
+    io_uring_cqe*               cqes_;
+
+    /*!< Operations prepared or submitted, whose callback has not run. */
+    unsigned int                in_flight_;
+    /*!< List of the operations in flight. */
+    operation*                  operations_;
+
+    io_uring_engine(const io_uring_engine&) = delete;
+    io_uring_engine& operator=(const io_uring_engine&) = delete;
+
+    static int sys_setup(unsigned int entries, io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    static int sys_enter(int fd, unsigned int to_submit,
+                         unsigned int min_complete, unsigned int flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                        min_complete, flags, nullptr, 0));
+    }
+
+    static int sys_register(int fd, unsigned int opcode, const void* arg,
+                            unsigned int count) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode,
+                                        arg, count));
+    }
+
+    template<typename T>
+    static T* at_offset(void* base, unsigned int offset) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+    void map_rings(const io_uring_params& params) {
+        sq_ring_size_ = params.sq_off.array +
+                params.sq_entries * sizeof(unsigned int);
+        cq_ring_size_ = params.cq_off.cqes +
+                params.cq_entries * sizeof(io_uring_cqe);
+        if (features_ & IORING_FEAT_SINGLE_MMAP) {
+            if (cq_ring_size_ > sq_ring_size_)
+                sq_ring_size_ = cq_ring_size_;
+            cq_ring_size_ = sq_ring_size_;
+        }
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            sq_ring_ = nullptr;
+            throw_errno("io_uring sq ring mmap");
+        }
+
+        if (features_ & IORING_FEAT_SINGLE_MMAP) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                cq_ring_ = nullptr;
+                throw_errno("io_uring cq ring mmap");
+            }
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            throw_errno("io_uring sqe mmap");
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sq_head_ = at_offset<std::atomic<unsigned int> >(sq_ring_,
+                                                         params.sq_off.head);
+        sq_tail_ = at_offset<std::atomic<unsigned int> >(sq_ring_,
+                                                         params.sq_off.tail);
+        sq_mask_ = *at_offset<unsigned int>(sq_ring_, params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = at_offset<unsigned int>(sq_ring_, params.sq_off.array);
+        sq_local_tail_ = sq_tail_->load(std::memory_order_relaxed);
+
+        cq_head_ = at_offset<std::atomic<unsigned int> >(cq_ring_,
+                                                         params.cq_off.head);
+        cq_tail_ = at_offset<std::atomic<unsigned int> >(cq_ring_,
+                                                         params.cq_off.tail);
+        cq_mask_ = *at_offset<unsigned int>(cq_ring_, params.cq_off.ring_mask);
+        cq_entries_ = params.cq_entries;
+        cqes_ = at_offset<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+    }
+
+    void unmap_rings() {
+        if (sqes_)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_)
+            munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_)
+            munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ != -1)
+            close(ring_fd_);
+    }
+
+    static void throw_errno(const char* what) {
+        throw std::system_error(errno, std::system_category(), what);
+    }
+
+    /**
+     * \brief Makes the prepared entries visible to the kernel.
+     */
+    void publish() {
+        const unsigned int published = sq_tail_->load(std::memory_order_relaxed);
+        if (published != sq_local_tail_) {
+            to_submit_ += sq_local_tail_ - published;
+            sq_tail_->store(sq_local_tail_, std::memory_order_release);
+        }
+    }
+
+    int enter(unsigned int min_complete, unsigned int flags) {
+        publish();
+        for (;;) {
+            const int result = sys_enter(ring_fd_, to_submit_, min_complete,
+                                         flags);
+            if (result >= 0) {
+                to_submit_ -= static_cast<unsigned int>(result);
+                return result;
+            }
+            if (errno != EINTR)
+                return -errno;
+        }
+    }
+
+    /**
+     * \brief Returns a free submission entry, submitting the prepared ones
+     *  if the ring is full, and reaping completions if too many operations
+     *  are in flight for the completion ring to hold their results.
+     */
+    io_uring_sqe* next_sqe() {
+        while (in_flight_ >= cq_entries_) {
+            if (run(1) < 0)
+                return nullptr;
+        }
+
+        unsigned int head = sq_head_->load(std::memory_order_acquire);
+        if (sq_local_tail_ - head >= sq_entries_) {
+            if (enter(0, 0) < 0)
+                return nullptr;
+            head = sq_head_->load(std::memory_order_acquire);
+            if (sq_local_tail_ - head >= sq_entries_)
+                return nullptr;
+        }
+
+        const unsigned int index = sq_local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        return sqe;
+    }
+
+    /**
+     * \brief Fills a submission entry and records the callback.
+     * \return False if no entry was available, the callback is then dropped.
+     */
+    bool prepare(unsigned char opcode, int fd, bool fixed_file,
+                 const void* addr, unsigned int len, unsigned long long offset,
+                 callback_t callback, unsigned short buf_index = 0,
+                 unsigned int op_flags = 0) {
+        io_uring_sqe* sqe = next_sqe();
+        if (!sqe)
+            return false;
+
+        operation* op = new operation();
+        op->callback_ = std::move(callback);
+        op->prev_ = nullptr;
+        op->next_ = operations_;
+        op->cancelling_ = false;
+        if (operations_)
+            operations_->prev_ = op;
+        operations_ = op;
+
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->flags = fixed_file ? IOSQE_FIXED_FILE : 0;
+        sqe->addr = reinterpret_cast<unsigned long long>(addr);
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->buf_index = buf_index;
+        sqe->fsync_flags = op_flags;
+        sqe->user_data = reinterpret_cast<unsigned long long>(op);
+
+        ++sq_local_tail_;
+        ++in_flight_;
+        return true;
+    }
+
+    void unlink(operation* op) {
+        if (op->prev_)
+            op->prev_->next_ = op->next_;
+        else
+            operations_ = op->next_;
+        if (op->next_)
+            op->next_->prev_ = op->prev_;
+    }
+
+    /**
+     * \brief Asks the kernel to cancel every operation in flight and waits
+     *  until all of them have completed, dropping their callbacks. Once it
+     *  returns, the kernel no longer touches the buffers of the operations.
+     *
+     *  The cancellation requests have a null user data, and are only queued
+     *  while the completion ring has room for their results too.
+     */
+    void cancel_all() {
+        unsigned int cancelling = 0;
+        while (in_flight_ || cancelling) {
+            for (operation* op = operations_; op; op = op->next_) {
+                if (op->cancelling_)
+                    continue;
+                if (cancelling && in_flight_ + cancelling >= cq_entries_)
+                    break;
+                const unsigned int head = sq_head_->load(std::memory_order_acquire);
+                if (sq_local_tail_ - head >= sq_entries_)
+                    break;
+
+                const unsigned int index = sq_local_tail_ & sq_mask_;
+                io_uring_sqe* sqe = &sqes_[index];
+                std::memset(sqe, 0, sizeof(*sqe));
+                sq_array_[index] = index;
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<unsigned long long>(op);
+                sqe->user_data = 0;
+                ++sq_local_tail_;
+                ++cancelling;
+                op->cancelling_ = true;
+            }
+
+            const int result = enter(1, IORING_ENTER_GETEVENTS);
+            if (result < 0 && result != -EBUSY && result != -EAGAIN)
+                return;
+
+            for (;;) {
+                const unsigned int head = cq_head_->load(std::memory_order_relaxed);
+                if (head == cq_tail_->load(std::memory_order_acquire))
+                    break;
+
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                operation* op = reinterpret_cast<operation*>(cqe.user_data);
+                cq_head_->store(head + 1, std::memory_order_release);
+
+                if (!op) {
+                    --cancelling;
+                    continue;
+                }
+                unlink(op);
+                --in_flight_;
+                delete op;
+            }
+        }
+    }
+
+    /**
+     * \brief Wraps the callback so that it keeps a copy of the handle.
+     */
+    template<typename management_policy, template<typename> class O>
+    static callback_t holding(const shared_handle<management_policy, O>& file,
+                              callback_t callback) {
+        shared_handle<management_policy, O> keeper(file);
+        return [keeper, callback](int result) {
+            callback(result);
+        };
+    }
+
+public :
+    /**
+     * \brief Creates a ring with room for entries submission entries.
+     * \throws std::system_error If io_uring is not available.
+     */
+    explicit io_uring_engine(unsigned int entries = 256, unsigned int flags = 0)
+        :       ring_fd_(-1),
+                features_(0),
+                sq_ring_(nullptr),
+                sq_ring_size_(0),
+                cq_ring_(nullptr),
+                cq_ring_size_(0),
+                sqes_(nullptr),
+                sqes_size_(0),
+                to_submit_(0),
+                in_flight_(0),
+                operations_(nullptr) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = flags;
+
+        ring_fd_ = sys_setup(entries, &params);
+        if (ring_fd_ < 0) {
+            ring_fd_ = -1;
+            throw_errno("io_uring_setup");
+        }
+        features_ = params.features;
+
+        try {
+            map_rings(params);
+        } catch (...) {
+            unmap_rings();
+            throw;
+        }
+    }
+
+    ~io_uring_engine() {
+        cancel_all();
+        unmap_rings();
+        while (operations_) {
+            operation* next = operations_->next_;
+            delete operations_;
+            operations_ = next;
+        }
+    }
+
+    /**
+     * \brief Tests if the kernel supports io_uring and allows its use.
+     */
+    static bool is_supported() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        const int fd = sys_setup(1, &params);
+        if (fd < 0)
+            return false;
+        close(fd);
+        return true;
+    }
+
+    /**
+     * \brief Registers descriptors, to be used through registered_file
+     *  objects holding their index in the array. The kernel takes its own
+     *  reference on the files.
+     * \return 0 or -errno.
+     */
+    int register_files(const int* fds, unsigned int count) {
+        return sys_register(ring_fd_, IORING_REGISTER_FILES, fds, count) < 0 ?
+                    -errno : 0;
+    }
+
+    int unregister_files() {
+        return sys_register(ring_fd_, IORING_UNREGISTER_FILES, nullptr, 0) < 0 ?
+                    -errno : 0;
+    }
+
+    /**
+     * \brief Registers buffers for read_fixed() and write_fixed(). The pages
+     *  are pinned once, instead of on every operation.
+     * \return 0 or -errno.
+     */
+    int register_buffers(const iovec* buffers, unsigned int count) {
+        return sys_register(ring_fd_, IORING_REGISTER_BUFFERS, buffers,
+                            count) < 0 ? -errno : 0;
+    }
+
+    int unregister_buffers() {
+        return sys_register(ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr,
+                            0) < 0 ? -errno : 0;
+    }
+
+    template<typename M, template<typename> class O>
+    bool read(const shared_handle<M, O>& file, void* buffer, unsigned int len,
+              unsigned long long offset, callback_t callback) {
+        return prepare(IORING_OP_READ, shared_handle_get(file), false, buffer,
+                       len, offset, holding(file, std::move(callback)));
+    }
+
+    bool read(registered_file file, void* buffer, unsigned int len,
+              unsigned long long offset, callback_t callback) {
+        return prepare(IORING_OP_READ, file.index_, true, buffer, len, offset,
+                       std::move(callback));
+    }
+
+    template<typename M, template<typename> class O>
+    bool write(const shared_handle<M, O>& file, const void* buffer,
+               unsigned int len, unsigned long long offset,
+               callback_t callback) {
+        return prepare(IORING_OP_WRITE, shared_handle_get(file), false, buffer,
+                       len, offset, holding(file, std::move(callback)));
+    }
+
+    bool write(registered_file file, const void* buffer, unsigned int len,
+               unsigned long long offset, callback_t callback) {
+        return prepare(IORING_OP_WRITE, file.index_, true, buffer, len, offset,
+                       std::move(callback));
+    }
+
+    template<typename M, template<typename> class O>
+    bool readv(const shared_handle<M, O>& file, const iovec* iov,
+               unsigned int count, unsigned long long offset,
+               callback_t callback) {
+        return prepare(IORING_OP_READV, shared_handle_get(file), false, iov,
+                       count, offset, holding(file, std::move(callback)));
+    }
+
+    bool readv(registered_file file, const iovec* iov, unsigned int count,
+               unsigned long long offset, callback_t callback) {
+        return prepare(IORING_OP_READV, file.index_, true, iov, count, offset,
+                       std::move(callback));
+    }
+
+    template<typename M, template<typename> class O>
+    bool writev(const shared_handle<M, O>& file, const iovec* iov,
+                unsigned int count, unsigned long long offset,
+                callback_t callback) {
+        return prepare(IORING_OP_WRITEV, shared_handle_get(file), false, iov,
+                       count, offset, holding(file, std::move(callback)));
+    }
+
+    bool writev(registered_file file, const iovec* iov, unsigned int count,
+                unsigned long long offset, callback_t callback) {
+        return prepare(IORING_OP_WRITEV, file.index_, true, iov, count, offset,
+                       std::move(callback));
+    }
+
+    /**
+     * \brief Reads into a slice of the registered buffer buf_index.
+     */
+    bool read_fixed(registered_file file, void* buffer, unsigned int len,
+                    unsigned long long offset, unsigned short buf_index,
+                    callback_t callback) {
+        return prepare(IORING_OP_READ_FIXED, file.index_, true, buffer, len,
+                       offset, std::move(callback), buf_index);
+    }
+
+    /**
+     * \brief Writes from a slice of the registered buffer buf_index.
+     */
+    bool write_fixed(registered_file file, const void* buffer,
+                     unsigned int len, unsigned long long offset,
+                     unsigned short buf_index, callback_t callback) {
+        return prepare(IORING_OP_WRITE_FIXED, file.index_, true, buffer, len,
+                       offset, std::move(callback), buf_index);
+    }
+
+    template<typename M, template<typename> class O>
+    bool fsync(const shared_handle<M, O>& file, bool data_only,
+               callback_t callback) {
+        return prepare(IORING_OP_FSYNC, shared_handle_get(file), false,
+                       nullptr, 0, 0, holding(file, std::move(callback)), 0,
+                       data_only ? IORING_FSYNC_DATASYNC : 0);
+    }
+
+    bool fsync(registered_file file, bool data_only, callback_t callback) {
+        return prepare(IORING_OP_FSYNC, file.index_, true, nullptr, 0, 0,
+                       std::move(callback), 0,
+                       data_only ? IORING_FSYNC_DATASYNC : 0);
+    }
+
+    /**
+     * \brief Submits all the prepared operations with a single system call.
+     * \return Number of operations submitted, or -errno.
+     */
+    int submit() {
+        return enter(0, 0);
+    }
+
+    /**
+     * \brief Submits the prepared operations, waits for at least
+     *  min_complete completions, and invokes the callbacks of all the
+     *  completed operations.
+     * \return Number of callbacks invoked, or -errno.
+     */
+    int run(unsigned int min_complete = 0) {
+        if (min_complete > in_flight_)
+            min_complete = in_flight_;
+
+        publish();
+        if (to_submit_ || min_complete) {
+            const int result = enter(min_complete,
+                                     min_complete ? IORING_ENTER_GETEVENTS : 0);
+            if (result < 0 && result != -EBUSY)
+                return result;
+        }
+
+        int completed = 0;
+        for (;;) {
+            // Reloaded on every iteration, callbacks may call run() too.
+            const unsigned int head = cq_head_->load(std::memory_order_relaxed);
+            if (head == cq_tail_->load(std::memory_order_acquire))
+                break;
+
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            operation* op = reinterpret_cast<operation*>(cqe.user_data);
+            const int result = cqe.res;
+            cq_head_->store(head + 1, std::memory_order_release);
+
+            unlink(op);
+            --in_flight_;
+            ++completed;
+            // The callback may prepare new operations.
+            callback_t callback(std::move(op->callback_));
+            delete op;
+            if (callback)
+                callback(result);
+        }
+        return completed;
+    }
+
+    /**
+     * \brief Number of operations whose callback has not run yet.
+     */
+    unsigned int in_flight() const {
+        return in_flight_;
+    }
+};
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "io_uring_engine.h"
+#include "scoped_handle.h"
+
+namespace {
+
+struct file_fd_policy : public handle_traits_base<int> {
+    static int closed_;
+
+    static int null_handle() {
+        return -1;
+    }
+
+    static void dispose(int fd) {
+        if (fd != -1) {
+            close(fd);
+            ++closed_;
+        }
+    }
+};
+
+int file_fd_policy::closed_ = 0;
+
+typedef shared_handle<file_fd_policy, counted_ownership> file_t;
+
+int open_temp_file() {
+    char path[] = "/tmp/io_uring_engine_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd != -1)
+        unlink(path);
+    return fd;
+}
+
+} // anonymous namespace
+
+class IoUringEngineTest : public ::testing::Test {
+protected :
+    void SetUp() {
+        if (!io_uring_engine::is_supported())
+            GTEST_SKIP() << "io_uring is not available";
+    }
+};
+
+TEST_F(IoUringEngineTest, write_fsync_read) {
+    io_uring_engine engine(8);
+    file_fd_policy::closed_ = 0;
+
+    const std::string text("hello, io_uring");
+    char buffer[32] = {};
+    int written = 0;
+    int synced = -1;
+    int read = 0;
+    {
+        file_t file(open_temp_file());
+        ASSERT_TRUE(file);
+        EXPECT_TRUE(engine.write(file, text.data(), text.size(), 0,
+                                 [&written](int result) { written = result; }));
+        EXPECT_EQ(1, engine.submit());
+        EXPECT_EQ(1, engine.run(1));
+        EXPECT_EQ(static_cast<int>(text.size()), written);
+
+        engine.fsync(file, true, [&synced](int result) { synced = result; });
+        engine.read(file, buffer, sizeof(buffer), 0,
+                    [&read](int result) { read = result; });
+    }
+    // The file is still referenced by the operations in flight.
+    EXPECT_EQ(0, file_fd_policy::closed_);
+    EXPECT_EQ(2u, engine.in_flight());
+
+    while (engine.in_flight())
+        ASSERT_LE(0, engine.run(1));
+    EXPECT_EQ(0, synced);
+    EXPECT_EQ(static_cast<int>(text.size()), read);
+    EXPECT_EQ(text, std::string(buffer));
+    EXPECT_EQ(1, file_fd_policy::closed_);
+}
+
+TEST_F(IoUringEngineTest, vectored_and_batched) {
+    io_uring_engine engine(4);
+    file_t file(open_temp_file());
+
+    char first[] = "abc";
+    char second[] = "defg";
+    iovec out[2] = { { first, 3 }, { second, 4 } };
+    int results[2] = { 0, 0 };
+    engine.writev(file, out, 2, 0, [&results](int result) {
+        results[0] = result;
+    });
+    // More operations than submission entries.
+    int completed = 0;
+    for (int i = 0; i < 10; ++i)
+        engine.write(file, "x", 1, 100 + i, [&completed](int) { ++completed; });
+    while (engine.in_flight())
+        ASSERT_LE(0, engine.run(1));
+    EXPECT_EQ(7, results[0]);
+    EXPECT_EQ(10, completed);
+
+    char in_first[4] = {};
+    char in_second[5] = {};
+    iovec in[2] = { { in_first, 3 }, { in_second, 4 } };
+    engine.readv(file, in, 2, 0, [&results](int result) {
+        results[1] = result;
+    });
+    engine.run(1);
+    EXPECT_EQ(7, results[1]);
+    EXPECT_STREQ("abc", in_first);
+    EXPECT_STREQ("defg", in_second);
+}
+
+TEST_F(IoUringEngineTest, registered_files_and_buffers) {
+    io_uring_engine engine(8);
+
+    int fd;
+    {
+        // The registration keeps the file open after the handle is gone.
+        scoped_handle<file_fd_policy> file(open_temp_file());
+        fd = scoped_handle_get(file);
+        ASSERT_EQ(0, engine.register_files(&fd, 1));
+    }
+
+    static char buffer[4096];
+    iovec registered = { buffer, sizeof(buffer) };
+    ASSERT_EQ(0, engine.register_buffers(&registered, 1));
+
+    std::strcpy(buffer, "fixed");
+    int written = 0;
+    engine.write_fixed(registered_file(0), buffer, 5, 0, 0,
+                       [&written](int result) { written = result; });
+    engine.run(1);
+    EXPECT_EQ(5, written);
+
+    std::memset(buffer, 0, sizeof(buffer));
+    int read = 0;
+    engine.read_fixed(registered_file(0), buffer + 100, 5, 0, 0,
+                      [&read](int result) { read = result; });
+    engine.run(1);
+    EXPECT_EQ(5, read);
+    EXPECT_STREQ("fixed", buffer + 100);
+
+    EXPECT_EQ(0, engine.unregister_buffers());
+    EXPECT_EQ(0, engine.unregister_files());
+}
+
+TEST_F(IoUringEngineTest, destructor_cancels_pending_reads) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    file_fd_policy::closed_ = 0;
+
+    char buffer[8] = {};
+    bool called = false;
+    {
+        io_uring_engine engine(8);
+        file_t reader(fds[0]);
+        // The pipe is empty, the read stays pending.
+        ASSERT_TRUE(engine.read(reader, buffer, sizeof(buffer) - 1, 0,
+                                [&called](int) { called = true; }));
+        ASSERT_EQ(1, engine.submit());
+        EXPECT_EQ(0, engine.run());
+        fds[0] = dup(fds[0]);
+    }
+    EXPECT_FALSE(called);
+    EXPECT_EQ(1, file_fd_policy::closed_);
+
+    // The cancelled read no longer consumes what is written to the pipe.
+    ASSERT_EQ(4, write(fds[1], "late", 4));
+    char late[8] = {};
+    EXPECT_EQ(4, ::read(fds[0], late, sizeof(late) - 1));
+    EXPECT_STREQ("late", late);
+    EXPECT_STREQ("", buffer);
+
+    close(fds[0]);
+    close(fds[1]);
+}
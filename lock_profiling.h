@@ -0,0 +1,491 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "lock_waiter.h"
+#include "scoped_lock.h"
+
+/**
+ * \brief Contention statistics of one lock, updated by
+ *      instrumented_lock_traits. Histogram bucket i counts durations d in
+ *      nanoseconds with 2^(i-1) <= d < 2^i (bucket 0 counts d == 0); the last
+ *      bucket also counts longer durations.
+ */
+struct lock_profile {
+    enum {
+        bucket_count = 32
+    };
+
+    /*!< Name given with profiled_lock_set_name(), or empty. */
+    std::string                 name_;
+    /*!< Address of the profiled lock, identifies unnamed locks. */
+    const void*                 lock_;
+
+    std::atomic<uint64_t>       acquisitions_;
+    /*!< Acquisitions that had to wait. */
+    std::atomic<uint64_t>       contended_;
+    std::atomic<uint64_t>       total_wait_ns_;
+    std::atomic<uint64_t>       total_hold_ns_;
+    std::atomic<uint64_t>       max_wait_ns_;
+    /*!< Return address in the function that waited max_wait_ns_. */
+    std::atomic<const void*>    max_wait_site_;
+    std::atomic<uint64_t>       wait_histogram_[bucket_count];
+    std::atomic<uint64_t>       hold_histogram_[bucket_count];
+
+    /*!< Links in the registry. */
+    lock_profile*               prev_;
+    lock_profile*               next_;
+
+    explicit lock_profile(const void* lock)
+        :       lock_(lock),
+                acquisitions_(0),
+                contended_(0),
+                total_wait_ns_(0),
+                total_hold_ns_(0),
+                max_wait_ns_(0),
+                max_wait_site_(nullptr),
+                prev_(nullptr),
+                next_(nullptr) {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            wait_histogram_[i].store(0, std::memory_order_relaxed);
+            hold_histogram_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static size_t bucket(uint64_t ns) {
+        if (!ns)
+            return 0;
+        const size_t index = 64 - __builtin_clzll(ns);
+        return index < bucket_count ? index : bucket_count - 1;
+    }
+
+    void record_wait(uint64_t ns, const void* site) {
+        contended_.fetch_add(1, std::memory_order_relaxed);
+        total_wait_ns_.fetch_add(ns, std::memory_order_relaxed);
+        wait_histogram_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t longest = max_wait_ns_.load(std::memory_order_relaxed);
+        while (ns > longest) {
+            if (max_wait_ns_.compare_exchange_weak(longest, ns,
+                                                   std::memory_order_relaxed)) {
+                // Not atomic with the duration: a racing update may pair
+                // the longest wait with the site of a slightly shorter one.
+                max_wait_site_.store(site, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+
+    void record_hold(uint64_t ns) {
+        total_hold_ns_.fetch_add(ns, std::memory_order_relaxed);
+        hold_histogram_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * \brief Copy of the statistics of a lock, returned by
+ *      lock_profile_registry::snapshot().
+ */
+struct lock_profile_stats {
+    std::string     name_;
+    const void*     lock_;
+    uint64_t        acquisitions_;
+    uint64_t        contended_;
+    uint64_t        total_wait_ns_;
+    uint64_t        total_hold_ns_;
+    uint64_t        max_wait_ns_;
+    const void*     max_wait_site_;
+    uint64_t        wait_histogram_[lock_profile::bucket_count];
+    uint64_t        hold_histogram_[lock_profile::bucket_count];
+};
+
+/**
+ * \brief Process wide list of the profiles of live instrumented locks.
+ */
+class lock_profile_registry {
+private :
+    std::mutex      lock_;
+    lock_profile*   head_;
+
+    lock_profile_registry() : head_(nullptr) {}
+
+    lock_profile_registry(const lock_profile_registry&) = delete;
+    lock_profile_registry& operator=(const lock_profile_registry&) = delete;
+
+    static void dump_histogram(std::ostream& out, const uint64_t* histogram,
+                               bool json) {
+        bool first = true;
+        for (size_t i = 0; i < lock_profile::bucket_count; ++i) {
+            if (!histogram[i])
+                continue;
+            // The last bucket also counts the longer durations.
+            const bool last = i + 1 == lock_profile::bucket_count;
+            const unsigned long long upper = 1ULL << i;
+            if (json && last)
+                out << (first ? "" : ", ") << "\"+Inf\": " << histogram[i];
+            else if (json)
+                out << (first ? "" : ", ") << "\"" << upper << "\": "
+                    << histogram[i];
+            else if (last)
+                out << (first ? "" : " ") << ">=" << (upper >> 1) << "ns:"
+                    << histogram[i];
+            else
+                out << (first ? "" : " ") << "<" << upper << "ns:"
+                    << histogram[i];
+            first = false;
+        }
+    }
+
+    static void dump_name(std::ostream& out, const lock_profile_stats& stats,
+                          bool json) {
+        if (stats.name_.empty()) {
+            out << "lock@" << stats.lock_;
+            return;
+        }
+        if (!json) {
+            out << stats.name_;
+            return;
+        }
+
+        static const char hex_digits[] = "0123456789abcdef";
+        for (size_t i = 0; i < stats.name_.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(stats.name_[i]);
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (c < 0x20)
+                out << "\\u00" << hex_digits[c >> 4] << hex_digits[c & 15];
+            else
+                out << c;
+        }
+    }
+
+public :
+    /**
+     * \brief The registry. Never destroyed, so that locks with static
+     *      storage duration can unregister at any time.
+     */
+    static lock_profile_registry& instance() {
+        static lock_profile_registry* registry = new lock_profile_registry();
+        return *registry;
+    }
+
+    void add(lock_profile* profile) {
+        std::lock_guard<std::mutex> guard(lock_);
+        profile->prev_ = nullptr;
+        profile->next_ = head_;
+        if (head_)
+            head_->prev_ = profile;
+        head_ = profile;
+    }
+
+    void remove(lock_profile* profile) {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (profile->prev_)
+            profile->prev_->next_ = profile->next_;
+        else
+            head_ = profile->next_;
+        if (profile->next_)
+            profile->next_->prev_ = profile->prev_;
+    }
+
+    /**
+     * \brief Names a profile. Call before the lock is used concurrently.
+     */
+    void set_name(lock_profile* profile, const std::string& name) {
+        std::lock_guard<std::mutex> guard(lock_);
+        profile->name_ = name;
+    }
+
+    /**
+     * \brief Copies the statistics of all the live instrumented locks.
+     */
+    std::vector<lock_profile_stats> snapshot() {
+        std::vector<lock_profile_stats> result;
+        std::lock_guard<std::mutex> guard(lock_);
+        for (lock_profile* profile = head_; profile; profile = profile->next_) {
+            lock_profile_stats stats;
+            stats.name_ = profile->name_;
+            stats.lock_ = profile->lock_;
+            stats.acquisitions_ = profile->acquisitions_.load(std::memory_order_relaxed);
+            stats.contended_ = profile->contended_.load(std::memory_order_relaxed);
+            stats.total_wait_ns_ = profile->total_wait_ns_.load(std::memory_order_relaxed);
+            stats.total_hold_ns_ = profile->total_hold_ns_.load(std::memory_order_relaxed);
+            stats.max_wait_ns_ = profile->max_wait_ns_.load(std::memory_order_relaxed);
+            stats.max_wait_site_ = profile->max_wait_site_.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < lock_profile::bucket_count; ++i) {
+                stats.wait_histogram_[i] =
+                        profile->wait_histogram_[i].load(std::memory_order_relaxed);
+                stats.hold_histogram_[i] =
+                        profile->hold_histogram_[i].load(std::memory_order_relaxed);
+            }
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+    /**
+     * \brief Writes one line per lock, and its histograms.
+     */
+    void dump_text(std::ostream& out) {
+        const std::vector<lock_profile_stats> stats = snapshot();
+        for (size_t i = 0; i < stats.size(); ++i) {
+            dump_name(out, stats[i], false);
+            out << ": acquisitions " << stats[i].acquisitions_
+                << ", contended " << stats[i].contended_
+                << ", wait " << stats[i].total_wait_ns_ << "ns"
+                << ", hold " << stats[i].total_hold_ns_ << "ns"
+                << ", max wait " << stats[i].max_wait_ns_ << "ns at "
+                << stats[i].max_wait_site_ << "\n  wait ";
+            dump_histogram(out, stats[i].wait_histogram_, false);
+            out << "\n  hold ";
+            dump_histogram(out, stats[i].hold_histogram_, false);
+            out << "\n";
+        }
+    }
+
+    /**
+     * \brief Writes a JSON array with one object per lock. Histograms map
+     *      the exclusive upper bound of a bucket, in nanoseconds, to its
+     *      count, "+Inf" for the last bucket; empty buckets are left out.
+     */
+    void dump_json(std::ostream& out) {
+        const std::vector<lock_profile_stats> stats = snapshot();
+        out << "[";
+        for (size_t i = 0; i < stats.size(); ++i) {
+            out << (i ? ",\n " : "\n ") << "{\"name\": \"";
+            dump_name(out, stats[i], true);
+            out << "\", \"acquisitions\": " << stats[i].acquisitions_
+                << ", \"contended\": " << stats[i].contended_
+                << ", \"total_wait_ns\": " << stats[i].total_wait_ns_
+                << ", \"total_hold_ns\": " << stats[i].total_hold_ns_
+                << ", \"max_wait_ns\": " << stats[i].max_wait_ns_
+                << ", \"max_wait_site\": \"" << stats[i].max_wait_site_
+                << "\", \"wait_histogram\": {";
+            dump_histogram(out, stats[i].wait_histogram_, true);
+            out << "}, \"hold_histogram\": {";
+            dump_histogram(out, stats[i].hold_histogram_, true);
+            out << "}}";
+        }
+        out << (stats.empty() ? "]\n" : "\n]\n");
+    }
+};
+
+/**
+ * \brief Wraps any lock traits class that has try_acquire(), and records
+ *      the statistics of each lock in a lock_profile: number of
+ *      acquisitions, of acquisitions that had to wait, wait and hold time
+ *      histograms, and the code address that waited longest (resolve it
+ *      with addr2line). That address is in the function that called
+ *      scoped_lock::acquire() or constructed the auto_lock, both always
+ *      inlined; other guards, such as auto_multi_lock, report their own. Uncontended acquisitions cost two extra clock reads
+ *      and a few relaxed atomic increments on the profile.
+ *      Queue lock traits (see lock_waiter) are wrapped with their waiter
+ *      state, and try_acquire_for() is available if the wrapped traits
+ *      implement it.
+ * \remarks Usually used through profiled_lock_traits, which only
+ *      instruments when LOCK_PROFILING is defined.
+ */
+template<typename LockTraits>
+struct instrumented_lock_traits {
+    typedef std::chrono::steady_clock   clock_t;
+
+    typedef typename lock_waiter<LockTraits>::type  waiter_t;
+
+    struct lock_t {
+        typename LockTraits::lock_t     lock_;
+        lock_profile*                   profile_;
+        /*!< Written by the owner, while holding the lock. */
+        clock_t::time_point             acquired_at_;
+    };
+
+    static uint64_t elapsed_ns(clock_t::time_point since,
+                               clock_t::time_point until) {
+        return static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        until - since).count());
+    }
+
+    static bool initialize(lock_t& lock) {
+        lock.profile_ = new lock_profile(&lock);
+        lock_profile_registry::instance().add(lock.profile_);
+        return LockTraits::initialize(lock.lock_);
+    }
+
+    static void dispose(lock_t& lock) {
+        LockTraits::dispose(lock.lock_);
+        lock_profile_registry::instance().remove(lock.profile_);
+        delete lock.profile_;
+    }
+
+    /**
+     * \brief Counts an acquisition, and its wait if it had to wait.
+     */
+    static void acquired(lock_t& lock, const clock_t::time_point* wait_start,
+                         const void* site) {
+        lock.acquired_at_ = clock_t::now();
+        if (wait_start)
+            lock.profile_->record_wait(elapsed_ns(*wait_start, lock.acquired_at_),
+                                       site);
+        lock.profile_->acquisitions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief The waiter argument is empty for traits without waiter state,
+     *      or the waiter of the calling thread.
+     */
+    template<typename... Waiter>
+    static void acquire_from(const void* site, lock_t& lock,
+                             Waiter&... waiter) {
+        if (LockTraits::try_acquire(lock.lock_, waiter...)) {
+            acquired(lock, nullptr, site);
+            return;
+        }
+        const clock_t::time_point start = clock_t::now();
+        LockTraits::acquire(lock.lock_, waiter...);
+        acquired(lock, &start, site);
+    }
+
+    template<typename... Waiter>
+    static bool try_acquire_from(lock_t& lock, Waiter&... waiter) {
+        if (!LockTraits::try_acquire(lock.lock_, waiter...))
+            return false;
+        acquired(lock, nullptr, nullptr);
+        return true;
+    }
+
+    template<typename... Waiter>
+    static void release_from(lock_t& lock, Waiter&... waiter) {
+        const uint64_t held = elapsed_ns(lock.acquired_at_, clock_t::now());
+        LockTraits::release(lock.lock_, waiter...);
+        lock.profile_->record_hold(held);
+    }
+
+    static bool try_acquire(lock_t& lock) {
+        return try_acquire_from(lock);
+    }
+
+    static bool try_acquire(lock_t& lock, waiter_t& waiter) {
+        return try_acquire_from(lock, waiter);
+    }
+
+    __attribute__((noinline)) static void acquire(lock_t& lock) {
+        acquire_from(__builtin_return_address(0), lock);
+    }
+
+    __attribute__((noinline)) static void acquire(lock_t& lock,
+                                                  waiter_t& waiter) {
+        acquire_from(__builtin_return_address(0), lock, waiter);
+    }
+
+    static void release(lock_t& lock) {
+        release_from(lock);
+    }
+
+    static void release(lock_t& lock, waiter_t& waiter) {
+        release_from(lock, waiter);
+    }
+
+    /**
+     * \brief Tries to acquire the lock, waiting for at most timeout. Only
+     *      available if the wrapped traits implement it.
+     */
+    template<typename rep_t, typename period_t, typename Traits = LockTraits>
+    __attribute__((noinline)) static auto try_acquire_for(
+            lock_t& lock, const std::chrono::duration<rep_t, period_t>& timeout)
+            -> decltype(Traits::try_acquire_for(lock.lock_, timeout)) {
+        if (LockTraits::try_acquire(lock.lock_)) {
+            acquired(lock, nullptr, nullptr);
+            return true;
+        }
+        const clock_t::time_point start = clock_t::now();
+        if (!Traits::try_acquire_for(lock.lock_, timeout))
+            return false;
+        acquired(lock, &start, __builtin_return_address(0));
+        return true;
+    }
+
+    /**
+     * \brief Profile of a lock, see scoped_lock_get_impl().
+     */
+    static lock_profile* profile(lock_t& lock) {
+        return lock.profile_;
+    }
+};
+
+#ifdef LOCK_PROFILING
+/**
+ * \brief Instruments the wrapped traits when LOCK_PROFILING is defined,
+ *      reduces to them otherwise.
+ */
+template<typename LockTraits>
+struct profiled_lock_traits : public instrumented_lock_traits<LockTraits> {};
+#else
+template<typename LockTraits>
+struct profiled_lock_traits : public LockTraits {};
+#endif
+
+/**
+ * \brief Statistics of a profiled lock, or nullptr when LOCK_PROFILING is
+ *      not defined.
+ */
+template<typename LockTraits>
+inline lock_profile* profiled_lock_profile(
+        scoped_lock<profiled_lock_traits<LockTraits> >& lock) {
+#ifdef LOCK_PROFILING
+    return profiled_lock_traits<LockTraits>::profile(scoped_lock_get_impl(lock));
+#else
+    (void)lock;
+    return nullptr;
+#endif
+}
+
+/**
+ * \brief Names a profiled lock in the dumps. Does nothing when
+ *      LOCK_PROFILING is not defined.
+ */
+template<typename LockTraits>
+inline void profiled_lock_set_name(
+        scoped_lock<profiled_lock_traits<LockTraits> >& lock,
+        const std::string& name) {
+    lock_profile* profile = profiled_lock_profile(lock);
+    if (profile)
+        lock_profile_registry::instance().set_name(profile, name);
+}
@@ -0,0 +1,602 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "auto_lock.h"
+#include "biased_rwlock.h"
+#include "futex_lock.h"
+#include "lock_profiling.h"
+#include "multi_lock.h"
+#include "posix_lock.h"
+#include "scoped_lock.h"
+#include "seqlock.h"
+#include "spin_lock.h"
+#include "striped_lock.h"
+
+namespace {
+
+/**
+ * \brief Increments a plain counter from several threads, under the lock.
+ */
+template<typename lock_type>
+unsigned long hammer(lock_type& lock, unsigned int threads,
+                     unsigned int iterations) {
+    unsigned long counter = 0;
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&lock, &counter, iterations]() {
+            for (unsigned int j = 0; j < iterations; ++j) {
+                auto_lock<lock_type> guard(lock);
+                ++counter;
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    return counter;
+}
+
+/**
+ * \brief Checks try_acquire and try_acquire_for while another thread holds
+ *  the lock.
+ */
+template<typename lock_type>
+void check_try_acquire(lock_type& lock) {
+    EXPECT_TRUE(lock.try_acquire());
+
+    bool acquired = true;
+    std::thread other([&lock, &acquired]() {
+        acquired = lock.try_acquire() ||
+                lock.try_acquire_for(std::chrono::milliseconds(20));
+    });
+    other.join();
+    EXPECT_FALSE(acquired);
+
+    std::thread waiter([&lock, &acquired]() {
+        acquired = lock.try_acquire_for(std::chrono::seconds(10));
+        if (acquired)
+            lock.release();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    lock.release();
+    waiter.join();
+    EXPECT_TRUE(acquired);
+}
+
+/**
+ * \brief Hands items from a producer to two consumers through a condition
+ *  variable, then checks timed waits.
+ */
+template<typename cond_traits>
+void check_condition() {
+    typedef scoped_condition<cond_traits> cond_type;
+    typename cond_type::lock_type lock;
+    cond_type ready;
+    std::vector<int> queue;
+    bool closed = false;
+    long consumed = 0;
+
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < 2; ++i) {
+        consumers.push_back(std::thread([&]() {
+            for (;;) {
+                auto_lock<typename cond_type::lock_type> guard(lock);
+                ready.wait(lock, [&]() { return closed || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                consumed += queue.back();
+                queue.pop_back();
+            }
+        }));
+    }
+    for (int i = 1; i <= 1000; ++i) {
+        auto_lock<typename cond_type::lock_type> guard(lock);
+        queue.push_back(i);
+        ready.notify_one();
+    }
+    {
+        auto_lock<typename cond_type::lock_type> guard(lock);
+        closed = true;
+        ready.notify_all();
+    }
+    for (size_t i = 0; i < consumers.size(); ++i)
+        consumers[i].join();
+    EXPECT_EQ(1000 * 1001 / 2, consumed);
+
+    auto_lock<typename cond_type::lock_type> guard(lock);
+    const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+    EXPECT_FALSE(ready.wait_for(lock, std::chrono::milliseconds(10),
+                                [&]() { return queue.size() > 0; }));
+    EXPECT_LE(std::chrono::milliseconds(10),
+              std::chrono::steady_clock::now() - start);
+    EXPECT_TRUE(ready.wait_for(lock, std::chrono::milliseconds(10),
+                               [&]() { return closed; }));
+}
+
+} // anonymous namespace
+
+TEST(futex_mutex_traits, mutual_exclusion) {
+    static_assert(sizeof(scoped_lock<futex_mutex_traits>) == 4,
+                  "futex mutex should fit in 4 bytes");
+    scoped_lock<futex_mutex_traits> lock;
+    EXPECT_EQ(8u * 20000, hammer(lock, 8, 20000));
+}
+
+TEST(futex_mutex_traits, try_acquire) {
+    scoped_lock<futex_mutex_traits> lock;
+    check_try_acquire(lock);
+}
+
+TEST(posix_mutex_traits, try_acquire) {
+    scoped_lock<posix_mutex_traits> lock;
+    check_try_acquire(lock);
+    EXPECT_EQ(4u * 10000, hammer(lock, 4, 10000));
+}
+
+TEST(ticket_lock_traits, mutual_exclusion) {
+    scoped_lock<ticket_lock_traits> lock;
+    EXPECT_EQ(4u * 5000, hammer(lock, 4, 5000));
+
+    EXPECT_TRUE(lock.try_acquire());
+    EXPECT_FALSE(lock.try_acquire());
+    lock.release();
+}
+
+TEST(mcs_lock_traits, mutual_exclusion) {
+    static_assert(lock_waiter<scoped_lock<mcs_lock_traits> >::required,
+                  "MCS lock needs a queue node per waiter");
+    static_assert(!lock_waiter<scoped_lock<ticket_lock_traits> >::required,
+                  "ticket lock needs no queue node");
+
+    scoped_lock<mcs_lock_traits> lock;
+    EXPECT_EQ(4u * 5000, hammer(lock, 4, 5000));
+
+    mcs_node first;
+    mcs_node second;
+    EXPECT_TRUE(lock.try_acquire(first));
+    EXPECT_FALSE(lock.try_acquire(second));
+    lock.release(first);
+}
+
+namespace {
+
+/**
+ * \brief Writers keep two counters equal; readers check that they never
+ *  observe them differing.
+ */
+template<typename rwlock_type>
+bool readers_see_consistent_state(rwlock_type& lock) {
+    unsigned long first = 0;
+    unsigned long second = 0;
+    std::atomic<bool> consistent(true);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread([&lock, &first, &second, &consistent]() {
+            for (int j = 0; j < 20000; ++j) {
+                auto_read_lock<rwlock_type> guard(lock);
+                if (first != second)
+                    consistent = false;
+            }
+        }));
+    }
+    for (int i = 0; i < 2; ++i) {
+        threads.push_back(std::thread([&lock, &first, &second]() {
+            for (int j = 0; j < 2000; ++j) {
+                auto_write_lock<rwlock_type> guard(lock);
+                ++first;
+                ++second;
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    return consistent && first == 4000 && second == 4000;
+}
+
+} // anonymous namespace
+
+TEST(posix_rwlock_traits, readers_and_writers) {
+    scoped_rwlock<posix_rwlock_traits> lock;
+    EXPECT_TRUE(readers_see_consistent_state(lock));
+
+    EXPECT_TRUE(lock.try_acquire_read());
+    EXPECT_TRUE(lock.try_acquire_read());
+    EXPECT_FALSE(lock.try_acquire_write());
+    lock.release_read();
+    lock.release_read();
+    EXPECT_TRUE(lock.try_acquire_write());
+    lock.release_write();
+}
+
+TEST(biased_rwlock_traits, readers_and_writers) {
+    scoped_rwlock<biased_rwlock_traits<> > lock;
+    EXPECT_TRUE(readers_see_consistent_state(lock));
+
+    EXPECT_TRUE(lock.try_acquire_read());
+    EXPECT_FALSE(lock.try_acquire_write());
+    bool other_reader = false;
+    std::thread reader([&lock, &other_reader]() {
+        other_reader = lock.try_acquire_read();
+        if (other_reader)
+            lock.release_read();
+    });
+    reader.join();
+    EXPECT_TRUE(other_reader);
+    lock.release_read();
+
+    EXPECT_TRUE(lock.try_acquire_write());
+    EXPECT_FALSE(lock.try_acquire_read());
+    lock.release_write();
+}
+
+namespace {
+
+struct snapshot {
+    unsigned long   version_;
+    double          offset_;
+    unsigned int    weights_[5];
+};
+
+} // anonymous namespace
+
+TEST(seqlock, readers_never_see_torn_values) {
+    snapshot initial = { 0, 0.0, { 0, 0, 0, 0, 0 } };
+    seqlock<snapshot> lock(initial);
+    std::atomic<bool> done(false);
+    std::atomic<bool> torn(false);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.push_back(std::thread([&lock, &done, &torn]() {
+            unsigned long last = 0;
+            while (!done) {
+                const snapshot value = lock.load();
+                for (int j = 0; j < 5; ++j)
+                    if (value.weights_[j] != value.version_)
+                        torn = true;
+                if (value.offset_ != value.version_ * 0.5 || value.version_ < last)
+                    torn = true;
+                last = value.version_;
+            }
+        }));
+    }
+    for (int i = 0; i < 2; ++i) {
+        threads.push_back(std::thread([&lock]() {
+            for (int j = 0; j < 5000; ++j) {
+                auto_seqlock_writer<snapshot> writer(lock);
+                ++writer->version_;
+                writer->offset_ = writer->version_ * 0.5;
+                for (int k = 0; k < 5; ++k)
+                    writer->weights_[k] = static_cast<unsigned int>(
+                                writer->version_);
+            }
+        }));
+    }
+    threads[4].join();
+    threads[3].join();
+    done = true;
+    for (int i = 0; i < 3; ++i)
+        threads[i].join();
+
+    EXPECT_FALSE(torn);
+    EXPECT_EQ(10000u, lock.load().version_);
+
+    snapshot replaced = { 1, 0.5, { 1, 1, 1, 1, 1 } };
+    lock.store(replaced);
+    EXPECT_EQ(1u, lock.load().version_);
+}
+
+namespace {
+
+typedef scoped_lock<instrumented_lock_traits<futex_mutex_traits> >
+        profiled_mutex;
+
+__attribute__((noinline)) void wait_in_guard(profiled_mutex& lock) {
+    auto_lock<profiled_mutex> guard(lock);
+}
+
+} // anonymous namespace
+
+TEST(instrumented_lock_traits, records_contention) {
+    typedef profiled_mutex lock_type;
+    lock_type lock;
+    lock_profile* profile = instrumented_lock_traits<futex_mutex_traits>::profile(
+                scoped_lock_get_impl(lock));
+    lock_profile_registry::instance().set_name(profile, "test.contended");
+
+    EXPECT_EQ(4u * 2000, hammer(lock, 4, 2000));
+
+    lock.acquire();
+    std::thread waiter([&lock]() {
+        wait_in_guard(lock);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lock.release();
+    waiter.join();
+
+    std::vector<lock_profile_stats> stats =
+            lock_profile_registry::instance().snapshot();
+    const lock_profile_stats* found = nullptr;
+    for (size_t i = 0; i < stats.size(); ++i)
+        if (stats[i].name_ == "test.contended")
+            found = &stats[i];
+    ASSERT_TRUE(found != nullptr);
+    EXPECT_EQ(4u * 2000 + 2, found->acquisitions_);
+    EXPECT_LE(1u, found->contended_);
+    EXPECT_LE(10000000u, found->max_wait_ns_);
+    // The wait is attributed to the function that holds the guard.
+    const char* site = static_cast<const char*>(found->max_wait_site_);
+    const char* function = reinterpret_cast<const char*>(&wait_in_guard);
+    EXPECT_TRUE(site > function && site < function + 256);
+
+    uint64_t holds = 0, waits = 0;
+    for (size_t i = 0; i < lock_profile::bucket_count; ++i) {
+        holds += found->hold_histogram_[i];
+        waits += found->wait_histogram_[i];
+    }
+    EXPECT_EQ(found->acquisitions_, holds);
+    EXPECT_EQ(found->contended_, waits);
+
+    std::ostringstream text, json;
+    lock_profile_registry::instance().dump_text(text);
+    lock_profile_registry::instance().dump_json(json);
+    EXPECT_NE(std::string::npos, text.str().find("test.contended: acquisitions"));
+    EXPECT_NE(std::string::npos, json.str().find("{\"name\": \"test.contended\""));
+}
+
+TEST(lock_profile_registry, last_bucket_counts_longer_waits) {
+    profiled_mutex lock;
+    lock_profile* profile = instrumented_lock_traits<futex_mutex_traits>::profile(
+                scoped_lock_get_impl(lock));
+    lock_profile_registry::instance().set_name(profile, "test.long_wait");
+    profile->record_wait(5000000000ULL, nullptr);
+    EXPECT_EQ(1u, profile->wait_histogram_[lock_profile::bucket_count - 1]);
+
+    std::ostringstream text, json;
+    lock_profile_registry::instance().dump_text(text);
+    lock_profile_registry::instance().dump_json(json);
+    EXPECT_NE(std::string::npos, text.str().find("wait >=1073741824ns:1\n"));
+    EXPECT_NE(std::string::npos,
+              json.str().find("\"wait_histogram\": {\"+Inf\": 1}"));
+}
+
+TEST(instrumented_lock_traits, forwards_waiters_and_timed_acquire) {
+    typedef scoped_lock<instrumented_lock_traits<mcs_lock_traits> > mcs_type;
+    static_assert(lock_waiter<mcs_type>::required,
+                  "the MCS waiter should be forwarded");
+    mcs_type mcs;
+    EXPECT_EQ(3u * 2000, hammer(mcs, 3, 2000));
+    EXPECT_EQ(3u * 2000, instrumented_lock_traits<mcs_lock_traits>::profile(
+                  scoped_lock_get_impl(mcs))->acquisitions_.load());
+
+    typedef scoped_lock<instrumented_lock_traits<futex_mutex_traits> > futex_type;
+    futex_type futex;
+    check_try_acquire(futex);
+    lock_profile* profile = instrumented_lock_traits<futex_mutex_traits>::profile(
+                scoped_lock_get_impl(futex));
+    EXPECT_EQ(2u, profile->acquisitions_.load());
+    EXPECT_EQ(1u, profile->contended_.load());
+}
+
+TEST(lock_profile_registry, json_escapes_names) {
+    scoped_lock<instrumented_lock_traits<posix_mutex_traits> > lock;
+    lock_profile_registry::instance().set_name(
+                instrumented_lock_traits<posix_mutex_traits>::profile(
+                    scoped_lock_get_impl(lock)),
+                "cache \"hot\"\\path\n");
+    std::ostringstream json;
+    lock_profile_registry::instance().dump_json(json);
+    EXPECT_NE(std::string::npos,
+              json.str().find("\"name\": \"cache \\\"hot\\\"\\\\path\\u000a\""));
+}
+
+TEST(profiled_lock_traits, compiles_away_when_disabled) {
+#ifndef LOCK_PROFILING
+    static_assert(sizeof(scoped_lock<profiled_lock_traits<futex_mutex_traits> >) ==
+                  sizeof(scoped_lock<futex_mutex_traits>),
+                  "profiled lock should be the plain lock");
+#endif
+    scoped_lock<profiled_lock_traits<posix_mutex_traits> > lock;
+    profiled_lock_set_name(lock, "test.profiled");
+    EXPECT_EQ(2u * 1000, hammer(lock, 2, 1000));
+#ifndef LOCK_PROFILING
+    EXPECT_TRUE(profiled_lock_profile(lock) == nullptr);
+#endif
+}
+
+TEST(auto_multi_lock, opposite_orders_do_not_deadlock) {
+    typedef scoped_lock<futex_mutex_traits> lock_type;
+    lock_type locks[3];
+    long balances[3] = { 1000, 1000, 1000 };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&locks, &balances, t]() {
+            for (int j = 0; j < 2000; ++j) {
+                const int from = (t + j) % 3;
+                const int to = (from + 1 + t % 2) % 3;
+                auto_multi_lock<lock_type, lock_type> guard(locks[from],
+                                                            locks[to]);
+                --balances[from];
+                ++balances[to];
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    EXPECT_EQ(3000, balances[0] + balances[1] + balances[2]);
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(locks[i].try_acquire());
+        locks[i].release();
+    }
+}
+
+TEST(auto_multi_lock, mixed_lock_types) {
+    scoped_lock<posix_mutex_traits> posix;
+    scoped_lock<mcs_lock_traits> mcs;
+    scoped_lock<ticket_lock_traits> ticket;
+    unsigned long counter = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.push_back(std::thread([&posix, &mcs, &ticket, &counter]() {
+            for (int j = 0; j < 2000; ++j) {
+                auto_multi_lock<scoped_lock<mcs_lock_traits>,
+                        scoped_lock<posix_mutex_traits>,
+                        scoped_lock<ticket_lock_traits> > guard(mcs, posix,
+                                                                ticket);
+                ++counter;
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    EXPECT_EQ(3u * 2000, counter);
+
+    // Held while another thread owns one of the locks: the guard must wait.
+    posix.acquire();
+    bool entered = false;
+    std::thread waiter([&posix, &mcs, &ticket, &entered]() {
+        auto_multi_lock<scoped_lock<mcs_lock_traits>,
+                scoped_lock<posix_mutex_traits>,
+                scoped_lock<ticket_lock_traits> > guard(mcs, posix, ticket);
+        entered = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(entered);
+    posix.release();
+    waiter.join();
+    EXPECT_TRUE(entered);
+}
+
+TEST(striped_lock, keyed_stripes) {
+    typedef striped_lock<futex_mutex_traits, 8> lock_type;
+    static_assert(sizeof(lock_type) == 8 * 64, "stripes should be padded");
+    lock_type lock;
+    EXPECT_EQ(lock_type::stripe_of(42), lock_type::stripe_of(42));
+    EXPECT_EQ(&lock.stripe_for(42), &lock.stripe_at(lock_type::stripe_of(42)));
+
+    bool spread[8] = {};
+    for (int key = 0; key < 64; ++key)
+        spread[lock_type::stripe_of(key)] = true;
+    for (int i = 0; i < 8; ++i)
+        EXPECT_TRUE(spread[i]);
+
+    long buckets[8] = {};
+    long total = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&lock, &buckets, &total, t]() {
+            for (int j = 0; j < 2000; ++j) {
+                const int key = t * 2000 + j;
+                if (j % 100 == 0) {
+                    auto_all_stripes_lock<lock_type> guard(lock);
+                    total = 0;
+                    for (int i = 0; i < 8; ++i)
+                        total += buckets[i];
+                } else if (j % 10 == 0) {
+                    auto_stripes_lock<lock_type> guard(lock, { key, key + 1 });
+                    ++buckets[lock_type::stripe_of(key)];
+                    --buckets[lock_type::stripe_of(key)];
+                } else {
+                    auto_stripe_lock<lock_type> guard(lock, key);
+                    ++buckets[lock_type::stripe_of(key)];
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    long sum = 0;
+    for (int i = 0; i < 8; ++i)
+        sum += buckets[i];
+    EXPECT_EQ(4 * (2000 - 200), sum);
+    EXPECT_LE(0, total);
+}
+
+TEST(striped_lock, duplicate_keys_and_queue_locks) {
+    typedef striped_lock<mcs_lock_traits, 4> lock_type;
+    lock_type lock;
+    const int keys[] = { 3, 3, 3 };
+    {
+        auto_stripes_lock<lock_type> guard(lock, keys, keys + 3);
+        EXPECT_EQ(1u, guard.count());
+        mcs_node node;
+        EXPECT_FALSE(lock.stripe_for(3).try_acquire(node));
+    }
+    {
+        auto_all_stripes_lock<lock_type> guard(lock);
+        mcs_node node;
+        for (size_t i = 0; i < lock_type::stripes; ++i)
+            EXPECT_FALSE(lock.stripe_at(i).try_acquire(node));
+    }
+    mcs_node node;
+    EXPECT_TRUE(lock.stripe_for(3).try_acquire(node));
+    lock.stripe_for(3).release(node);
+}
+
+TEST(posix_condition_traits, producer_consumers) {
+    check_condition<posix_condition_traits>();
+}
+
+TEST(futex_condition_traits, producer_consumers) {
+    check_condition<futex_condition_traits>();
+}
+
+TEST(futex_event, auto_reset) {
+    futex_event event;
+    EXPECT_FALSE(event.try_wait());
+    EXPECT_FALSE(event.wait_for(std::chrono::milliseconds(5)));
+
+    std::atomic<int> passed(0);
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 3; ++i) {
+        waiters.push_back(std::thread([&event, &passed]() {
+            event.wait();
+            ++passed;
+        }));
+    }
+    // Each set() lets exactly one waiter through.
+    for (int i = 1; i <= 3; ++i) {
+        event.set();
+        while (passed.load() < i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        EXPECT_EQ(i, passed.load());
+    }
+    for (size_t i = 0; i < waiters.size(); ++i)
+        waiters[i].join();
+
+    event.set();
+    EXPECT_TRUE(event.try_wait());
+    EXPECT_FALSE(event.try_wait());
+}
+
+TEST(futex_event, manual_reset) {
+    futex_event event(true);
+    std::atomic<int> passed(0);
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 3; ++i) {
+        waiters.push_back(std::thread([&event, &passed]() {
+            if (event.wait_for(std::chrono::seconds(10)))
+                ++passed;
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    event.set();
+    for (size_t i = 0; i < waiters.size(); ++i)
+        waiters[i].join();
+    EXPECT_EQ(3, passed.load());
+
+    EXPECT_TRUE(event.try_wait());
+    EXPECT_TRUE(event.try_wait());
+    event.reset();
+    EXPECT_FALSE(event.try_wait());
+}
@@ -0,0 +1,64 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <type_traits>
+
+/**
+ * \brief Waiter type of lock traits that do not need per waiter state.
+ */
+struct no_waiter {};
+
+/**
+ * \brief Detects the per waiter state required by a lock traits class, or
+ *      by a lock class. Queue locks such as MCS make every waiting thread
+ *      spin on its own node; such traits declare the node type as waiter_t,
+ *      and take a reference to it in acquire() and release(). For all the
+ *      other types, lock_waiter<T>::type is no_waiter.
+ * \see auto_lock, scoped_lock
+ */
+template<typename T>
+struct lock_waiter {
+private :
+    template<typename U>
+    static typename U::waiter_t* test(int);
+
+    template<typename>
+    static no_waiter* test(...);
+
+public :
+    typedef typename std::remove_pointer<decltype(test<T>(0))>::type   type;
+
+    enum {
+        required = !std::is_same<type, no_waiter>::value
+    };
+};
@@ -0,0 +1,266 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "handle_traits.h"
+#include "scoped_handle.h"
+#include "shared_handle.h"
+
+/**
+ * \brief A region of memory mapped with mmap(): start address and length.
+ */
+struct mapping_region {
+    void*   addr_;
+    size_t  length_;
+};
+
+inline bool operator==(const mapping_region& left, const mapping_region& right) {
+    return left.addr_ == right.addr_ && left.length_ == right.length_;
+}
+
+inline bool operator!=(const mapping_region& left, const mapping_region& right) {
+    return !(left == right);
+}
+
+/**
+ * \brief Management policy for mapped regions, unmapped with munmap().
+ */
+struct mapping_policy : public handle_traits_base<mapping_region> {
+    static mapping_region null_handle() {
+        mapping_region region = { nullptr, 0 };
+        return region;
+    }
+
+    static void dispose(const mapping_region& region) {
+        if (region.addr_)
+            munmap(region.addr_, region.length_);
+    }
+};
+
+/**
+ * \brief Unique owner of a mapped region.
+ */
+typedef scoped_handle<mapping_policy>                       scoped_mapping;
+
+/**
+ * \brief Shared owner of a mapped region, unmapped when the last owner goes
+ *  away. Meant for read only mappings handed to several threads, hence the
+ *  thread safe counted_ownership.
+ */
+typedef shared_handle<mapping_policy, counted_ownership>    shared_mapping;
+
+/**
+ * \brief Flags for map_file() and map_whole_file().
+ */
+enum mapping_flags {
+    /*!< Read only mapping (the default). */
+    map_read_only = 0,
+    /*!< Mapping can be written to. */
+    map_read_write = 1 << 0,
+    /*!< Writes are not carried to the file (copy on write). */
+    map_private = 1 << 1,
+    /*!< Prefault the whole region, so that accessing it does not page fault. */
+    map_populate = 1 << 2
+};
+
+/**
+ * \brief Hints for mapping_advise().
+ */
+enum mapping_advice {
+    advise_normal = MADV_NORMAL,
+    /*!< Pages will be accessed in order, read ahead aggressively. */
+    advise_sequential = MADV_SEQUENTIAL,
+    /*!< Pages will be accessed in random order, do not read ahead. */
+    advise_random = MADV_RANDOM,
+    /*!< Pages will be needed soon, start reading them in. */
+    advise_willneed = MADV_WILLNEED,
+    /*!< Pages will not be needed soon. */
+    advise_dontneed = MADV_DONTNEED
+};
+
+/**
+ * \brief Maps length bytes of a file, starting at offset, which must be a
+ *  multiple of the page size.
+ * \return The mapped region, or the null region on failure, with errno set.
+ */
+inline mapping_region map_file(int fd, size_t length, off_t offset = 0,
+                               int flags = map_read_only) {
+    const int protection = (flags & map_read_write) ?
+                PROT_READ | PROT_WRITE : PROT_READ;
+    int map_flags = (flags & map_private) ? MAP_PRIVATE : MAP_SHARED;
+    if (flags & map_populate)
+        map_flags |= MAP_POPULATE;
+
+    void* addr = mmap(nullptr, length, protection, map_flags, fd, offset);
+    if (addr == MAP_FAILED)
+        return mapping_policy::null_handle();
+
+    mapping_region region = { addr, length };
+    return region;
+}
+
+/**
+ * \brief Maps a whole file. Empty files cannot be mapped, the null region is
+ *  returned for them, with errno set to EINVAL.
+ * \remarks Not an overload of map_file(), where an int length would bind to
+ *  flags.
+ */
+inline mapping_region map_whole_file(int fd, int flags = map_read_only) {
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+        return mapping_policy::null_handle();
+    return map_file(fd, static_cast<size_t>(info.st_size), 0, flags);
+}
+
+/**
+ * \brief Gives the kernel a hint about how a region will be accessed.
+ * \return 0 on success, -1 with errno set otherwise.
+ */
+inline int mapping_advise(const mapping_region& region, mapping_advice advice) {
+    return madvise(region.addr_, region.length_, advice);
+}
+
+/**
+ * \brief Advice for part of a region. offset must be a multiple of the page
+ *  size.
+ */
+inline int mapping_advise(const mapping_region& region, size_t offset,
+                          size_t length, mapping_advice advice) {
+    return madvise(static_cast<char*>(region.addr_) + offset, length, advice);
+}
+
+/**
+ * \brief Resizes a mapping, for instance after the underlying file has been
+ *  appended to. The region may move to a new address, so views into it are
+ *  invalidated; this is why only unique owners can be remapped.
+ * \return True on success. On failure the mapping is left unchanged and
+ *  errno is set.
+ */
+inline bool mapping_remap(scoped_mapping& mapping, size_t new_length) {
+    mapping_region* region = scoped_handle_get_impl(mapping);
+    if (!region->addr_)
+        return false;
+
+    void* addr = mremap(region->addr_, region->length_, new_length,
+                        MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED)
+        return false;
+
+    region->addr_ = addr;
+    region->length_ = new_length;
+    return true;
+}
+
+/**
+ * \brief Typed, non owning view of a contiguous sequence of objects.
+ */
+template<typename T>
+class mapped_span {
+public :
+    typedef T           value_type;
+    typedef T*          iterator;
+    typedef const T*    const_iterator;
+
+private :
+    T*      data_;
+    size_t  size_;
+
+public :
+    mapped_span() : data_(nullptr), size_(0) {}
+
+    mapped_span(T* data, size_t size) : data_(data), size_(size) {}
+
+    T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    T* begin() const {
+        return data_;
+    }
+
+    T* end() const {
+        return data_ + size_;
+    }
+
+    T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    /**
+     * \brief View of count elements starting at offset.
+     */
+    mapped_span<T> subspan(size_t offset, size_t count) const {
+        return mapped_span<T>(data_ + offset, count);
+    }
+};
+
+/**
+ * \brief Views a region as an array of T, starting at byte offset. Trailing
+ *  bytes that do not make up a whole T are not part of the view.
+ * \remarks The data is accessed in place, without copying; T should be a
+ *  trivially copyable type laid out as in the file, and offset must be
+ *  suitably aligned for T.
+ */
+template<typename T>
+inline mapped_span<T> mapping_view(const mapping_region& region,
+                                   size_t offset = 0) {
+    if (offset >= region.length_)
+        return mapped_span<T>();
+    return mapped_span<T>(
+                reinterpret_cast<T*>(static_cast<char*>(region.addr_) + offset),
+                (region.length_ - offset) / sizeof(T));
+}
+
+template<typename T>
+inline mapped_span<T> mapping_view(const scoped_mapping& mapping,
+                                   size_t offset = 0) {
+    return mapping_view<T>(scoped_handle_get(mapping), offset);
+}
+
+template<typename T>
+inline mapped_span<T> mapping_view(const shared_mapping& mapping,
+                                   size_t offset = 0) {
+    return mapping_view<T>(shared_handle_get(mapping), offset);
+}
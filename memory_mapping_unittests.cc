@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "memory_mapping.h"
+
+namespace {
+
+struct fd_policy : public handle_traits_base<int> {
+    static int null_handle() {
+        return -1;
+    }
+
+    static void dispose(int fd) {
+        if (fd != -1)
+            close(fd);
+    }
+};
+
+/**
+ * \brief Creates an unlinked temporary file holding count 32 bit integers,
+ *  with values 0, 1, 2, ...
+ */
+int make_data_file(uint32_t count) {
+    char path[] = "/tmp/memory_mapping_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd == -1)
+        return -1;
+    unlink(path);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (write(fd, &i, sizeof(i)) != sizeof(i)) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+} // anonymous namespace
+
+TEST(memory_mapping, scoped_view) {
+    scoped_handle<fd_policy> file(make_data_file(1000));
+    ASSERT_TRUE(file);
+
+    scoped_mapping mapping(map_whole_file(scoped_handle_get(file), map_populate));
+    ASSERT_TRUE(mapping);
+    EXPECT_EQ(0, mapping_advise(scoped_handle_get(mapping), advise_sequential));
+
+    mapped_span<const uint32_t> values = mapping_view<const uint32_t>(mapping);
+    ASSERT_EQ(1000u, values.size());
+    uint64_t sum = 0;
+    for (const uint32_t* it = values.begin(); it != values.end(); ++it)
+        sum += *it;
+    EXPECT_EQ(999u * 1000u / 2, sum);
+
+    mapped_span<const uint32_t> tail = mapping_view<const uint32_t>(mapping, 3996);
+    ASSERT_EQ(1u, tail.size());
+    EXPECT_EQ(999u, tail[0]);
+    EXPECT_EQ(10u, values.subspan(10, 5)[0]);
+}
+
+TEST(memory_mapping, empty_file_and_failure) {
+    scoped_handle<fd_policy> file(make_data_file(0));
+    scoped_mapping mapping(map_whole_file(scoped_handle_get(file)));
+    EXPECT_FALSE(mapping);
+    EXPECT_TRUE(mapping_view<char>(mapping).empty());
+    EXPECT_FALSE(mapping_remap(mapping, 4096));
+}
+
+TEST(memory_mapping, remap_after_append) {
+    scoped_handle<fd_policy> file(make_data_file(1024));
+    const int fd = scoped_handle_get(file);
+    scoped_mapping mapping(map_file(fd, 4096, 0, map_read_write));
+    ASSERT_TRUE(mapping);
+
+    mapping_view<uint32_t>(mapping)[0] = 42;
+    ASSERT_EQ(0, ftruncate(fd, 3 * 4096));
+    ASSERT_TRUE(mapping_remap(mapping, 3 * 4096));
+
+    mapped_span<uint32_t> values = mapping_view<uint32_t>(mapping);
+    EXPECT_EQ(3u * 1024, values.size());
+    EXPECT_EQ(42u, values[0]);
+    EXPECT_EQ(1023u, values[1023]);
+    EXPECT_EQ(0u, values[3 * 1024 - 1]);
+}
+
+TEST(memory_mapping, map_prefix) {
+    scoped_handle<fd_policy> file(make_data_file(4096));
+    const int length = 4096;
+    scoped_mapping mapping(map_file(scoped_handle_get(file), length));
+    ASSERT_TRUE(mapping);
+    EXPECT_EQ(4096u, scoped_handle_get(mapping).length_);
+    EXPECT_EQ(1024u, mapping_view<const uint32_t>(mapping).size());
+}
+
+TEST(memory_mapping, shared_read_only) {
+    scoped_handle<fd_policy> file(make_data_file(16));
+    shared_mapping first(map_whole_file(scoped_handle_get(file)));
+    ASSERT_TRUE(first);
+    {
+        shared_mapping second(first);
+        EXPECT_EQ(2u, shared_handle_use_count(first));
+        EXPECT_EQ(15u, mapping_view<const uint32_t>(second)[15]);
+    }
+    EXPECT_EQ(1u, shared_handle_use_count(first));
+}
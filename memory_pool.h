@@ -0,0 +1,321 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+/**
+ * \brief Small object allocator with per thread, size segregated free lists.
+ *
+ *  Requests of up to max_small_size bytes are rounded up to a multiple of
+ *  size_class_granularity and served from the free list of the calling
+ *  thread's heap, which is refilled by carving slabs obtained from operator
+ *  new. Each block is preceded by a header recording the heap and the size
+ *  class it belongs to. A block released by its owner thread goes back on
+ *  the owner's free list, without synchronization. A block released by
+ *  another thread is pushed onto a lock free remote list of the owner heap,
+ *  which the owner takes over in one step when its local list runs out.
+ *  Larger requests are forwarded to operator new.
+ * \remarks Slabs are never returned to the system. When a thread exits its
+ *  heap is kept, with its free blocks, and handed to the next new thread.
+ *  Blocks are aligned to 16 bytes.
+ * \see pooled_storage
+ */
+class memory_pool {
+public :
+    enum {
+        size_class_granularity = 16,
+        size_class_count = 16,
+        max_small_size = size_class_granularity * size_class_count,
+        slab_size = 64 * 1024,
+        alignment = 16
+    };
+
+private :
+    struct free_block {
+        free_block* next_;
+    };
+
+    struct thread_heap {
+        /*!< Free blocks, used only by the owner thread. */
+        free_block*                 local_[size_class_count];
+        /*!< Blocks released by other threads. */
+        std::atomic<free_block*>    remote_[size_class_count];
+        /*!< Link in the list of heaps left behind by exited threads. */
+        thread_heap*                next_abandoned_;
+
+        thread_heap() : next_abandoned_(nullptr) {
+            for (size_t i = 0; i < size_class_count; ++i) {
+                local_[i] = nullptr;
+                remote_[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /**
+     * \brief Precedes every block. Written once, when the block is carved.
+     */
+    struct alignas(alignment) block_header {
+        /*!< Owner heap, or nullptr for blocks allocated with operator new. */
+        thread_heap*    heap_;
+        size_t          size_class_;
+    };
+
+    /**
+     * \brief Hands the heap of a thread over to the pool when it exits.
+     */
+    struct thread_heap_holder {
+        thread_heap*    heap_;
+
+        thread_heap_holder() : heap_(nullptr) {}
+
+        ~thread_heap_holder() {
+            if (heap_) {
+                current_heap() = nullptr;
+                abandon_heap(heap_);
+            }
+        }
+    };
+
+    struct abandoned_heaps {
+        std::mutex      lock_;
+        thread_heap*    head_;
+
+        abandoned_heaps() : head_(nullptr) {}
+    };
+
+    static abandoned_heaps& abandoned() {
+        static abandoned_heaps heaps;
+        return heaps;
+    }
+
+    static thread_heap*& current_heap() {
+        static thread_local thread_heap* heap = nullptr;
+        return heap;
+    }
+
+    static thread_heap* heap() {
+        thread_heap*& heap = current_heap();
+        if (!heap) {
+            static thread_local thread_heap_holder holder;
+            heap = adopt_heap();
+            holder.heap_ = heap;
+        }
+        return heap;
+    }
+
+    static thread_heap* adopt_heap() {
+        abandoned_heaps& heaps = abandoned();
+        {
+            std::lock_guard<std::mutex> guard(heaps.lock_);
+            if (heaps.head_) {
+                thread_heap* heap = heaps.head_;
+                heaps.head_ = heap->next_abandoned_;
+                return heap;
+            }
+        }
+        return new thread_heap();
+    }
+
+    static void abandon_heap(thread_heap* heap) {
+        abandoned_heaps& heaps = abandoned();
+        std::lock_guard<std::mutex> guard(heaps.lock_);
+        heap->next_abandoned_ = heaps.head_;
+        heaps.head_ = heap;
+    }
+
+    static size_t block_size(size_t size_class) {
+        return sizeof(block_header) + (size_class + 1) * size_class_granularity;
+    }
+
+    static block_header* header_of(void* ptr) {
+        return static_cast<block_header*>(ptr) - 1;
+    }
+
+    /**
+     * \brief Carves a new slab into blocks of the given size class and puts
+     *  them on the local free list of the heap.
+     */
+    static void refill(thread_heap* heap, size_t size_class) {
+        const size_t size = block_size(size_class);
+        char* slab = static_cast<char*>(::operator new(slab_size));
+
+        for (size_t offset = 0; offset + size <= slab_size; offset += size) {
+            block_header* header = reinterpret_cast<block_header*>(slab + offset);
+            header->heap_ = heap;
+            header->size_class_ = size_class;
+
+            free_block* block = reinterpret_cast<free_block*>(header + 1);
+            block->next_ = heap->local_[size_class];
+            heap->local_[size_class] = block;
+        }
+    }
+
+    static void push_remote(thread_heap* heap, size_t size_class,
+                            free_block* block) {
+        std::atomic<free_block*>& list = heap->remote_[size_class];
+        free_block* head = list.load(std::memory_order_relaxed);
+        do {
+            block->next_ = head;
+        } while (!list.compare_exchange_weak(head, block,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+    }
+
+public :
+    memory_pool() = delete;
+
+    /**
+     * \brief Allocates a block of at least size bytes.
+     */
+    static void* allocate(size_t size) {
+        if (size == 0)
+            size = 1;
+
+        const size_t size_class = (size - 1) / size_class_granularity;
+        if (size_class >= size_class_count) {
+            block_header* header = static_cast<block_header*>(
+                        ::operator new(sizeof(block_header) + size));
+            header->heap_ = nullptr;
+            header->size_class_ = size_class;
+            return header + 1;
+        }
+
+        thread_heap* owner = heap();
+        free_block* block = owner->local_[size_class];
+        if (!block) {
+            block = owner->remote_[size_class].exchange(
+                        nullptr, std::memory_order_acquire);
+            if (!block) {
+                refill(owner, size_class);
+                block = owner->local_[size_class];
+            }
+        }
+
+        owner->local_[size_class] = block->next_;
+        return block;
+    }
+
+    /**
+     * \brief Releases a block obtained from allocate(). May be called from
+     *  any thread.
+     */
+    static void deallocate(void* ptr) {
+        if (!ptr)
+            return;
+
+        block_header* header = header_of(ptr);
+        if (!header->heap_) {
+            ::operator delete(header);
+            return;
+        }
+
+        free_block* block = static_cast<free_block*>(ptr);
+        thread_heap* owner = current_heap();
+        if (header->heap_ == owner) {
+            block->next_ = owner->local_[header->size_class_];
+            owner->local_[header->size_class_] = block;
+        } else {
+            push_remote(header->heap_, header->size_class_, block);
+        }
+    }
+
+    /**
+     * \brief Makes sure the calling thread has at least count free blocks
+     *  large enough for size bytes, so that the first allocations do not
+     *  have to carve slabs. Typically called at thread startup.
+     */
+    static void prewarm(size_t size, size_t count) {
+        if (size == 0 || size > max_small_size)
+            return;
+
+        const size_t size_class = (size - 1) / size_class_granularity;
+        thread_heap* owner = heap();
+
+        size_t available = 0;
+        for (free_block* block = owner->local_[size_class];
+             block && available < count; block = block->next_)
+            ++available;
+
+        const size_t per_slab = slab_size / block_size(size_class);
+        for (; available < count; available += per_slab)
+            refill(owner, size_class);
+    }
+};
+
+/**
+ * \brief Storage policy for objects allocated from the memory_pool. Objects
+ *  must be created with pooled_storage<T>::create(), and can then be owned
+ *  by scoped_ptr or shared_pointer objects declared with this policy. They
+ *  may be released on any thread.
+ * \remarks When a pointer to a base class is owned, the base subobject must be
+ *  at offset 0 and the destructor must be virtual.
+ * \see memory_pool
+ */
+template<typename T>
+struct pooled_storage {
+    static_assert(alignof(T) <= memory_pool::alignment,
+                  "Over-aligned types are not supported!");
+
+    template<typename... Args>
+    static T* create(Args&&... args) {
+        void* memory = memory_pool::allocate(sizeof(T));
+        try {
+            return new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            memory_pool::deallocate(memory);
+            throw;
+        }
+    }
+
+    static void dispose(T* ptr) {
+        if (ptr) {
+            ptr->~T();
+            memory_pool::deallocate(ptr);
+        }
+    }
+
+    /**
+     * \brief Pre-allocates room for count objects on the calling thread.
+     */
+    static void prewarm(size_t count) {
+        memory_pool::prewarm(sizeof(T), count);
+    }
+
+    enum {
+        is_array_ptr = 0
+    };
+};
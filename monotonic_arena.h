@@ -0,0 +1,194 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * \brief Region allocator that hands out memory by bumping a pointer inside
+ *  a chunk, and releases everything it handed out at once with reset().
+ *  When the current chunk is exhausted a new one, twice as large, is
+ *  obtained from operator new.
+ * \remarks Not thread safe; use one arena per request or per thread. The
+ *  objects created in an arena must not outlive it, or the last reset().
+ *  Destructors are not run by the arena; owning the objects with
+ *  arena_storage pointers takes care of that.
+ * \see arena_storage
+ */
+class monotonic_arena {
+private :
+    struct chunk {
+        chunk*  next_;
+        size_t  size_;
+
+        char* begin() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        char* end() {
+            return begin() + size_;
+        }
+    };
+
+    /*!< Most recently allocated chunk, head of the chunk list. */
+    chunk*  chunks_;
+    /*!< Next free byte in the current chunk. */
+    char*   cursor_;
+    /*!< End of the current chunk. */
+    char*   limit_;
+    /*!< Size of the next chunk to allocate. */
+    size_t  next_chunk_size_;
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+    static char* align_up(char* ptr, size_t alignment) {
+        const uintptr_t value = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((alignment - value % alignment) % alignment);
+    }
+
+    void* allocate_slow(size_t size, size_t alignment) {
+        size_t chunk_size = next_chunk_size_;
+        while (chunk_size < size + alignment)
+            chunk_size *= 2;
+
+        chunk* fresh = static_cast<chunk*>(
+                    ::operator new(sizeof(chunk) + chunk_size));
+        fresh->next_ = chunks_;
+        fresh->size_ = chunk_size;
+        chunks_ = fresh;
+        next_chunk_size_ = chunk_size * 2;
+
+        char* result = align_up(fresh->begin(), alignment);
+        cursor_ = result + size;
+        limit_ = fresh->end();
+        return result;
+    }
+
+public :
+    explicit monotonic_arena(size_t initial_chunk_size = 4096)
+        : chunks_(nullptr),
+          cursor_(nullptr),
+          limit_(nullptr),
+          next_chunk_size_(initial_chunk_size ? initial_chunk_size : 1) {}
+
+    ~monotonic_arena() {
+        while (chunks_) {
+            chunk* next = chunks_->next_;
+            ::operator delete(chunks_);
+            chunks_ = next;
+        }
+    }
+
+    /**
+     * \brief Allocates size bytes aligned to alignment, which must be a
+     *  power of two.
+     */
+    void* allocate(size_t size,
+                   size_t alignment = alignof(std::max_align_t)) {
+        char* result = align_up(cursor_, alignment);
+        if (cursor_ && result + size <= limit_) {
+            cursor_ = result + size;
+            return result;
+        }
+        return allocate_slow(size, alignment);
+    }
+
+    /**
+     * \brief Constructs an object of type T in the arena.
+     */
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(
+                    std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief Releases all the memory handed out so far. The largest (most
+     *  recent) chunk is kept for reuse, the others are freed.
+     */
+    void reset() {
+        if (!chunks_)
+            return;
+
+        chunk* current = chunks_->next_;
+        while (current) {
+            chunk* next = current->next_;
+            ::operator delete(current);
+            current = next;
+        }
+
+        chunks_->next_ = nullptr;
+        cursor_ = chunks_->begin();
+        limit_ = chunks_->end();
+    }
+
+    /**
+     * \brief Number of bytes reserved from the system.
+     */
+    size_t capacity() const {
+        size_t total = 0;
+        for (const chunk* current = chunks_; current; current = current->next_)
+            total += current->size_;
+        return total;
+    }
+};
+
+/**
+ * \brief Storage policy for objects created with monotonic_arena::create().
+ *  Disposing of a pointer only runs the destructor, and compiles to nothing
+ *  for trivially destructible types; the memory is reclaimed when the arena
+ *  is reset or destroyed.
+ * \see monotonic_arena
+ */
+template<typename T>
+struct arena_storage {
+    static void dispose(T* ptr) {
+        destroy(ptr, std::is_trivially_destructible<T>());
+    }
+
+    enum {
+        is_array_ptr = 0
+    };
+
+private :
+    static void destroy(T*, std::true_type) {}
+
+    static void destroy(T* ptr, std::false_type) {
+        if (ptr)
+            ptr->~T();
+    }
+};
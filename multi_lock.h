@@ -0,0 +1,160 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <tuple>
+
+#include "auto_lock.h"
+
+/**
+ * \brief Holds several locks at once, for the lifetime of the object, without
+ *      requiring a global lock order. The constructor blocks on one lock and
+ *      only tries the others; if one of them is busy, it releases everything
+ *      and starts over by blocking on the busy one. A thread therefore never
+ *      waits while holding a lock, so no lock order can deadlock, and it
+ *      sleeps on the lock that is actually contended instead of on the first
+ *      one of a fixed order while holding the rest.
+ * \remarks Each lock class must implement acquire(), try_acquire() and
+ *      release() (the waiter_t overloads for queue locks, see lock_waiter).
+ *      The same lock must not be passed twice.
+ * \see auto_lock
+ */
+template<typename... LockTs>
+class auto_multi_lock {
+private :
+    enum {
+        lock_count = sizeof...(LockTs)
+    };
+
+    static_assert(lock_count > 0, "auto_multi_lock needs at least one lock");
+
+    /**
+     * \brief One lock and its waiter state, with the type erased so that the
+     *      acquisition loop can index them.
+     */
+    struct entry {
+        void*   lock_;
+        void*   waiter_;
+        void    (*acquire_)(void*, void*);
+        bool    (*try_acquire_)(void*, void*);
+        void    (*release_)(void*, void*);
+    };
+
+    template<typename LockT>
+    struct entry_ops {
+        typedef typename lock_waiter<LockT>::type   waiter_t;
+
+        static void acquire(void* lock, void* waiter) {
+            lock_waiter_ops<LockT>::acquire(*static_cast<LockT*>(lock),
+                                            *static_cast<waiter_t*>(waiter));
+        }
+
+        static bool try_acquire(void* lock, void* waiter) {
+            return lock_waiter_ops<LockT>::try_acquire(
+                        *static_cast<LockT*>(lock),
+                        *static_cast<waiter_t*>(waiter));
+        }
+
+        static void release(void* lock, void* waiter) {
+            lock_waiter_ops<LockT>::release(*static_cast<LockT*>(lock),
+                                            *static_cast<waiter_t*>(waiter));
+        }
+    };
+
+    /*!< Queue nodes of this thread, for the locks that need one */
+    std::tuple<typename lock_waiter<LockTs>::type...>   waiters_;
+    entry                                               entries_[lock_count];
+
+    template<size_t index>
+    void bind() {}
+
+    template<size_t index, typename LockT, typename... Rest>
+    void bind(LockT& lock, Rest&... rest) {
+        entry& e = entries_[index];
+        e.lock_ = &lock;
+        e.waiter_ = &std::get<index>(waiters_);
+        e.acquire_ = &entry_ops<LockT>::acquire;
+        e.try_acquire_ = &entry_ops<LockT>::try_acquire;
+        e.release_ = &entry_ops<LockT>::release;
+        bind<index + 1>(rest...);
+    }
+
+    void acquire_all() {
+        size_t first = 0;
+        for (;;) {
+            entries_[first].acquire_(entries_[first].lock_,
+                                     entries_[first].waiter_);
+
+            size_t busy = first;
+            for (size_t step = 1; step < lock_count; ++step) {
+                const size_t i = (first + step) % lock_count;
+                if (!entries_[i].try_acquire_(entries_[i].lock_,
+                                              entries_[i].waiter_)) {
+                    busy = i;
+                    break;
+                }
+            }
+            if (busy == first)
+                return;
+
+            for (size_t i = first; i != busy; i = (i + 1) % lock_count)
+                entries_[i].release_(entries_[i].lock_, entries_[i].waiter_);
+            first = busy;
+            // Give the owner of the busy lock a chance to finish, rather
+            // than racing it again right away.
+            std::this_thread::yield();
+        }
+    }
+
+public :
+    /**
+     * \brief Acquires all the locks.
+     * \param locks References to lock class objects, eg. scoped_lock.
+     */
+    explicit auto_multi_lock(LockTs&... locks) {
+        bind<0>(locks...);
+        acquire_all();
+    }
+
+    /**
+     * \brief Releases all the locks, in the reverse order of the arguments.
+     */
+    ~auto_multi_lock() {
+        for (size_t i = lock_count; i-- > 0; )
+            entries_[i].release_(entries_[i].lock_, entries_[i].waiter_);
+    }
+
+    auto_multi_lock(const auto_multi_lock&) = delete;
+    auto_multi_lock& operator=(const auto_multi_lock&) = delete;
+};
@@ -31,6 +31,12 @@
 
 #pragma once
 
+#include <cassert>
+#include <type_traits>
+#include "biased_refcount_impl.h"
+#include "intrusive_refcount_impl.h"
+#include "shared_control_block.h"
+
 template<typename T>
 struct default_storage {
     static void dispose(T* ptr) {
@@ -53,6 +59,27 @@ struct default_array_storage {
     };
 };
 
+/**
+ * \brief Storage policy for objects created by make_shared_pointer. Destroys
+ *      the object and releases the single allocation holding both the
+ *      object and its shared_control_block.
+ * \see control_block_refcount, make_shared_pointer
+ */
+template<typename T>
+struct control_block_storage {
+    static void dispose(T* ptr) {
+        if (ptr) {
+            shared_control_block* block = shared_control_block::of(ptr);
+            block->destroy_(block);
+            block->release_weak_ref();
+        }
+    }
+
+    enum {
+        is_array_ptr = 0
+    };
+};
+
 template<typename T>
 struct intrusive_refcount {
     static void add_ref(const T* obj) {
@@ -61,9 +88,136 @@ struct intrusive_refcount {
     }
 
     static bool dec_ref(const T* obj) {
+        return obj ? obj->dec_ref() : false;
+    }
+
+    enum {
+        is_thread_safe = 0
+    };
+};
+
+/**
+ * \brief Reference policy for objects that are shared between threads.
+ *      The objects must derive from atomic_intrusive_refcount_impl, which
+ *      is enforced at compile time, so that a shared_pointer declared with
+ *      this policy can never end up using a non atomic counter.
+ * \see atomic_intrusive_refcount_impl
+ */
+template<typename T>
+struct atomic_intrusive_refcount {
+    static void add_ref(const T* obj) {
+        static_assert(
+            std::is_base_of<atomic_intrusive_refcount_impl, T>::value,
+            "Type must derive from atomic_intrusive_refcount_impl!");
         if (obj)
-            obj->dec_ref();
+            obj->atomic_intrusive_refcount_impl::add_ref();
     }
+
+    static bool dec_ref(const T* obj) {
+        static_assert(
+            std::is_base_of<atomic_intrusive_refcount_impl, T>::value,
+            "Type must derive from atomic_intrusive_refcount_impl!");
+        return obj ? obj->atomic_intrusive_refcount_impl::dec_ref() : false;
+    }
+
+    enum {
+        is_thread_safe = 1
+    };
+};
+
+/**
+ * \brief Reference policy for objects that are mostly used by the thread
+ *      that created them. The objects must derive from biased_refcount_impl.
+ * \see biased_refcount_impl
+ */
+template<typename T>
+struct biased_refcount {
+    static void add_ref(const T* obj) {
+        static_assert(std::is_base_of<biased_refcount_impl, T>::value,
+                      "Type must derive from biased_refcount_impl!");
+        if (obj)
+            obj->biased_refcount_impl::add_ref();
+    }
+
+    static bool dec_ref(const T* obj) {
+        static_assert(std::is_base_of<biased_refcount_impl, T>::value,
+                      "Type must derive from biased_refcount_impl!");
+        return obj ? obj->biased_refcount_impl::dec_ref() : false;
+    }
+
+    enum {
+        is_thread_safe = 1
+    };
+};
+
+/**
+ * \brief Reference policy for objects created by make_shared_pointer. The
+ *      count lives in a shared_control_block placed before the object, so
+ *      the object's type does not need to implement reference counting.
+ *      Must be used together with control_block_storage.
+ * \remarks A shared_pointer using this policy may only be converted to a
+ *      pointer to a base class of a standard layout type, whose base
+ *      subobject is at offset 0. Both rules are checked at compile time by
+ *      shared_pointer.
+ * \see shared_control_block, make_shared_pointer
+ */
+template<typename T>
+struct control_block_refcount {
+    static void add_ref(const T* obj) {
+        if (obj)
+            shared_control_block::of(obj)->strong_.fetch_add(
+                    1, std::memory_order_relaxed);
+    }
+
+    static bool dec_ref(const T* obj) {
+        if (!obj)
+            return false;
+
+        if (shared_control_block::of(obj)->strong_.fetch_sub(
+                    1, std::memory_order_release) != 1)
+            return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    static shared_control_block* control_block(const T* obj) {
+        return shared_control_block::of(obj);
+    }
+
+    enum {
+        is_thread_safe = 1
+    };
+};
+
+/**
+ * \brief Reference policy for objects deriving from
+ *      weak_intrusive_refcount_impl, which can be referenced by
+ *      weak_pointer objects.
+ * \see weak_intrusive_refcount_impl, weak_pointer
+ */
+template<typename T>
+struct weak_intrusive_refcount {
+    static void add_ref(const T* obj) {
+        static_assert(std::is_base_of<weak_intrusive_refcount_impl, T>::value,
+                      "Type must derive from weak_intrusive_refcount_impl!");
+        if (obj)
+            obj->weak_intrusive_refcount_impl::add_ref();
+    }
+
+    static bool dec_ref(const T* obj) {
+        static_assert(std::is_base_of<weak_intrusive_refcount_impl, T>::value,
+                      "Type must derive from weak_intrusive_refcount_impl!");
+        return obj ? obj->weak_intrusive_refcount_impl::dec_ref() : false;
+    }
+
+    static shared_control_block* control_block(const T* obj) {
+        return obj->weak_intrusive_refcount_impl::control_block();
+    }
+
+    enum {
+        is_thread_safe = 1
+    };
 };
 
 template<typename T>
@@ -74,9 +228,17 @@ struct com_refcount {
     }
 
     static bool dec_ref(const T* obj) {
+        //
+        // Release() destroys the object itself, so there is nothing left
+        // for the storage policy to do.
         if (obj)
             obj->Release();
+        return false;
     }
+
+    enum {
+        is_thread_safe = 0
+    };
 };
 
 template<typename T>
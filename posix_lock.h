@@ -31,6 +31,9 @@
 
 #pragma once
 
+#include <cerrno>
+#include <chrono>
+#include <ctime>
 #include <pthread.h>
 
 struct posix_mutex_traits {
@@ -52,36 +55,123 @@ struct posix_mutex_traits {
         pthread_mutex_unlock(&mtx);
     }
 
-    static void try_acquire(lock_t& mtx) {
-        pthread_mutex_trylock(&mtx);
+    static bool try_acquire(lock_t& mtx) {
+        return pthread_mutex_trylock(&mtx) == 0;
+    }
+
+    /**
+     * \brief Tries to acquire the mutex, waiting for at most timeout.
+     * \remarks pthread_mutex_timedlock() measures the deadline against the
+     *      realtime clock, so the wait is affected by changes of the system
+     *      time.
+     */
+    template<typename rep_t, typename period_t>
+    static bool try_acquire_for(
+            lock_t& mtx, const std::chrono::duration<rep_t, period_t>& timeout) {
+        const std::chrono::nanoseconds wait =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += static_cast<time_t>(wait.count() / 1000000000);
+        deadline.tv_nsec += static_cast<long>(wait.count() % 1000000000);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            ++deadline.tv_sec;
+        }
+        return pthread_mutex_timedlock(&mtx, &deadline) == 0;
     }
 };
 
+/**
+ * \brief Condition variable traits for pthread condition variables, paired
+ *      with posix_mutex_traits; usable with scoped_condition. Timed waits
+ *      use the monotonic clock, so they are not affected by changes of the
+ *      system time.
+ */
+struct posix_condition_traits {
+    typedef pthread_cond_t      cond_t;
+    typedef posix_mutex_traits  lock_traits_t;
+
+    static bool initialize(cond_t& cond) {
+        pthread_condattr_t attributes;
+        if (pthread_condattr_init(&attributes))
+            return false;
+        pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+        const bool result = pthread_cond_init(&cond, &attributes) == 0;
+        pthread_condattr_destroy(&attributes);
+        return result;
+    }
+
+    static void dispose(cond_t& cond) {
+        pthread_cond_destroy(&cond);
+    }
+
+    static void wait(cond_t& cond, lock_traits_t::lock_t& mtx) {
+        pthread_cond_wait(&cond, &mtx);
+    }
 
+    /**
+     * \brief Waits until notified or until the deadline passes.
+     * \return False if the wait timed out.
+     * \remarks Assumes steady_clock is CLOCK_MONOTONIC, as it is on Linux.
+     */
+    static bool wait_until(cond_t& cond, lock_traits_t::lock_t& mtx,
+                           std::chrono::steady_clock::time_point deadline) {
+        const std::chrono::nanoseconds since_epoch =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    deadline.time_since_epoch());
+        timespec absolute;
+        absolute.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+        absolute.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+        return pthread_cond_timedwait(&cond, &mtx, &absolute) != ETIMEDOUT;
+    }
+
+    static void notify_one(cond_t& cond) {
+        pthread_cond_signal(&cond);
+    }
+
+    static void notify_all(cond_t& cond) {
+        pthread_cond_broadcast(&cond);
+    }
+};
+
+
+/**
+ * \brief Lock traits for pthread read/write locks, usable with scoped_rwlock.
+ */
 struct posix_rwlock_traits {
-    typedef pthread_rwlock_t    mutex_t;
+    typedef pthread_rwlock_t    lock_t;
 
-    static bool initialize(mutex_t& rwlock) {
-        return pthread_rwlock_init(&rwlock, nullptr);
+    static bool initialize(lock_t& rwlock) {
+        return pthread_rwlock_init(&rwlock, nullptr) == 0;
     }
 
-    static bool destroy(mutex_t& rwlock) {
-        return pthread_rwlock_destroy(&rwlock);
+    static void dispose(lock_t& rwlock) {
+        pthread_rwlock_destroy(&rwlock);
     }
 
-    static void acquire_rd(mutex_t& rwlock) {
+    static void acquire_rd(lock_t& rwlock) {
         pthread_rwlock_rdlock(&rwlock);
     }
 
-    static void acquire_wr(mutex_t& rwlock) {
+    static void acquire_wr(lock_t& rwlock) {
         pthread_rwlock_wrlock(&rwlock);
     }
 
-    static bool try_acquire_rd(mutex_t& rwlock) {
+    static bool try_acquire_rd(lock_t& rwlock) {
         return pthread_rwlock_tryrdlock(&rwlock) == 0;
     }
 
-    static bool try_acquire_wr(mutex_t& rwlock) {
+    static bool try_acquire_wr(lock_t& rwlock) {
         return pthread_rwlock_trywrlock(&rwlock) == 0;
     }
+
+    static void release_rd(lock_t& rwlock) {
+        pthread_rwlock_unlock(&rwlock);
+    }
+
+    static void release_wr(lock_t& rwlock) {
+        pthread_rwlock_unlock(&rwlock);
+    }
 };
@@ -137,7 +137,7 @@ public :
      * \brief Returns a pointer to the owned handle.
      */
     friend inline handle_ptr_t scoped_handle_get_impl(self_t& sh) {
-        return sh.get_impl();
+        return sh.get_impl_ptr();
     }
 
     /**
@@ -31,6 +31,9 @@
 
 #pragma once
 
+#include <chrono>
+#include "lock_waiter.h"
+
 /**
  * \brief RAII class for an OS specific synchronization primitive
  *      (critical section, mutex, etc). This class is best used in conjunction
@@ -43,6 +46,8 @@ public :
     /*!< The primitive type */
     typedef typename LockTypeTraits::lock_t    lock_t;
     typedef scoped_lock<LockTypeTraits>        self_t;
+    /*!< Per waiter state, no_waiter unless the traits require one */
+    typedef typename lock_waiter<LockTypeTraits>::type waiter_t;
 
 private :
     /*!< Owned primitive */
@@ -71,12 +76,22 @@ public :
     /**
      * \brief Acquire the lock.
      * \remarks This call will block the calling thread, until the lock becomes
-     *          available.
+     *          available. Always inlined, so that instrumented_lock_traits
+     *          attributes the wait to the caller.
      */
-    void acquire() {
+    __attribute__((always_inline)) void acquire() {
         LockTypeTraits::acquire(lock_);
     }
 
+    /**
+     * \brief Acquire the lock, for traits that require per waiter state.
+     * \param waiter State of the calling thread, which must stay valid
+     *          until the matching release() call.
+     */
+    __attribute__((always_inline)) void acquire(waiter_t& waiter) {
+        LockTypeTraits::acquire(lock_, waiter);
+    }
+
     /**
      * \brief If owning the lock, release it.
      * \remarks Must be called after a call to acquire() or
@@ -88,12 +103,205 @@ public :
         LockTypeTraits::release(lock_);
     }
 
+    /**
+     * \brief Release the lock, acquired with the same waiter state.
+     */
+    void release(waiter_t& waiter) {
+        LockTypeTraits::release(lock_, waiter);
+    }
+
     /**
      * \brief Try acquiring the lock, but do not block waiting for it to become
      *          available.
      * \return True if the lock was acquired, false if not.
      */
-    void try_acquire() {
-        LockTypeTraits::try_acquire(lock_);
+    bool try_acquire() {
+        return LockTypeTraits::try_acquire(lock_);
+    }
+
+    /**
+     * \brief Try acquiring the lock with per waiter state, but do not block.
+     */
+    bool try_acquire(waiter_t& waiter) {
+        return LockTypeTraits::try_acquire(lock_, waiter);
+    }
+
+    /**
+     * \brief Try acquiring the lock, blocking for at most timeout.
+     * \return True if the lock was acquired, false if not.
+     * \remarks Only available if the traits class implements it.
+     */
+    template<typename Rep, typename Period>
+    bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return LockTypeTraits::try_acquire_for(lock_, timeout);
+    }
+
+    /**
+     * \brief Access to the owned primitive, for code that needs the
+     *          traits specific state (eg. profiling or condition variables).
+     */
+    friend inline lock_t& scoped_lock_get_impl(self_t& lock) {
+        return lock.lock_;
+    }
+};
+
+/**
+ * \brief RAII class for a read/write lock primitive. The traits class must
+ *      define lock_t, initialize(), dispose(), and the acquire_rd(),
+ *      acquire_wr(), try_acquire_rd(), try_acquire_wr(), release_rd() and
+ *      release_wr() functions. Best used with the auto_read_lock and
+ *      auto_write_lock guards.
+ * \see auto_read_lock, auto_write_lock, posix_rwlock_traits
+ */
+template<typename LockTypeTraits>
+class scoped_rwlock {
+public :
+    /*!< The primitive type */
+    typedef typename LockTypeTraits::lock_t    lock_t;
+    typedef scoped_rwlock<LockTypeTraits>      self_t;
+
+private :
+    /*!< Owned primitive */
+    lock_t  lock_;
+
+public :
+    scoped_rwlock() {
+        LockTypeTraits::initialize(lock_);
+    }
+
+    scoped_rwlock(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    ~scoped_rwlock() {
+        LockTypeTraits::dispose(lock_);
+    }
+
+    /**
+     * \brief Acquire the lock for reading, shared with other readers.
+     */
+    void acquire_read() {
+        LockTypeTraits::acquire_rd(lock_);
+    }
+
+    /**
+     * \brief Acquire the lock for writing, exclusively.
+     */
+    void acquire_write() {
+        LockTypeTraits::acquire_wr(lock_);
+    }
+
+    bool try_acquire_read() {
+        return LockTypeTraits::try_acquire_rd(lock_);
+    }
+
+    bool try_acquire_write() {
+        return LockTypeTraits::try_acquire_wr(lock_);
+    }
+
+    void release_read() {
+        LockTypeTraits::release_rd(lock_);
+    }
+
+    void release_write() {
+        LockTypeTraits::release_wr(lock_);
+    }
+};
+
+/**
+ * \brief RAII class for a condition variable, used with a scoped_lock of
+ *      the lock traits it pairs with. The traits class must define cond_t,
+ *      lock_traits_t, initialize(), dispose(), wait(), wait_until() and the
+ *      notify_one() and notify_all() functions.
+ * \remarks The wait functions must be called with the lock held, and return
+ *      with it held. Waits may wake up spuriously; prefer the predicate
+ *      overloads.
+ * \see posix_condition_traits, futex_condition_traits
+ */
+template<typename CondTypeTraits>
+class scoped_condition {
+public :
+    /*!< The primitive type */
+    typedef typename CondTypeTraits::cond_t                     cond_t;
+    typedef scoped_lock<typename CondTypeTraits::lock_traits_t> lock_type;
+    typedef scoped_condition<CondTypeTraits>                    self_t;
+    typedef std::chrono::steady_clock                           clock_t;
+
+private :
+    /*!< Owned primitive */
+    cond_t  cond_;
+
+public :
+    scoped_condition() {
+        CondTypeTraits::initialize(cond_);
+    }
+
+    scoped_condition(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    ~scoped_condition() {
+        CondTypeTraits::dispose(cond_);
+    }
+
+    /**
+     * \brief Releases the lock, waits for a notification and reacquires it.
+     */
+    void wait(lock_type& lock) {
+        CondTypeTraits::wait(cond_, scoped_lock_get_impl(lock));
+    }
+
+    /**
+     * \brief Waits until pred() returns true.
+     */
+    template<typename Predicate>
+    void wait(lock_type& lock, Predicate pred) {
+        while (!pred())
+            wait(lock);
+    }
+
+    /**
+     * \brief Waits for a notification, until the deadline at most.
+     * \return False if the wait timed out.
+     */
+    bool wait_until(lock_type& lock, clock_t::time_point deadline) {
+        return CondTypeTraits::wait_until(cond_, scoped_lock_get_impl(lock),
+                                          deadline);
+    }
+
+    /**
+     * \brief Waits until pred() returns true, or the deadline passes.
+     * \return The last value of pred().
+     */
+    template<typename Predicate>
+    bool wait_until(lock_type& lock, clock_t::time_point deadline,
+                    Predicate pred) {
+        while (!pred()) {
+            if (!wait_until(lock, deadline))
+                return pred();
+        }
+        return true;
+    }
+
+    template<typename rep_t, typename period_t>
+    bool wait_for(lock_type& lock,
+                  const std::chrono::duration<rep_t, period_t>& timeout) {
+        return wait_until(lock, clock_t::now() +
+                          std::chrono::duration_cast<clock_t::duration>(timeout));
+    }
+
+    template<typename rep_t, typename period_t, typename Predicate>
+    bool wait_for(lock_type& lock,
+                  const std::chrono::duration<rep_t, period_t>& timeout,
+                  Predicate pred) {
+        return wait_until(lock, clock_t::now() +
+                          std::chrono::duration_cast<clock_t::duration>(timeout),
+                          pred);
+    }
+
+    void notify_one() {
+        CondTypeTraits::notify_one(cond_);
+    }
+
+    void notify_all() {
+        CondTypeTraits::notify_all(cond_);
     }
 };
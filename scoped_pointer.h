@@ -115,10 +115,8 @@ public :
      * \brief Construct from an rvalue object with a convertible pointer type.
      */
     template<typename U>
-    scoped_ptr(scoped_ptr<U, management_policy, checking_policy>&& right)
-        : pointee_(right.pointee_) {
-        right.pointee_ = nullptr;
-    }
+    scoped_ptr(scoped_ptr<U, storage_policy, checking_policy>&& right)
+        : pointee_(scoped_pointer_release(right)) {}
 
     scoped_ptr(const self_t&) = delete;
     self_t& operator=(const self_t&) = delete;
@@ -134,12 +132,11 @@ public :
 
     template<typename U>
     self_t& operator=(
-            scoped_ptr<U, management_policy, checking_policy>&& right
+            scoped_ptr<U, storage_policy, checking_policy>&& right
             )
     {
         spolicy_t::dispose(pointee_);
-        pointee_ = right.pointee_;
-        right.pointee_ = nullptr;
+        pointee_ = scoped_pointer_release(right);
         return *this;
     }
 
@@ -179,7 +176,7 @@ public :
         static_assert(spolicy_t::is_array_ptr,
                       "Subscripting only applies to pointer to array!");
         checkpolicy_t::check_ptr(pointee_);
-        return ptr_[index];
+        return pointee_[index];
     }
 
     /**
@@ -189,7 +186,7 @@ public :
         static_assert(spolicy_t::is_array_ptr,
                       "Subscripting only applies to pointer to array!");
         checkpolicy_t::check_ptr(pointee_);
-        return ptr_[index];
+        return pointee_[index];
     }
 
     /**
@@ -244,22 +241,22 @@ public :
     }
 };
 
-template<typename T, typename U, typename W>
+template<typename T, template<typename> class U, template<typename> class W>
 inline bool operator==(const T* left, scoped_ptr<T, U, W>& right) {
     return left == scoped_pointer_get(right);
 }
 
-template<typename T, typename U, typename W>
+template<typename T, template<typename> class U, template<typename> class W>
 inline bool operator!=(const T* left, scoped_ptr<T, U, W>& right) {
     return !(left == right);
 }
 
-template<typename T, typename U, typename W>
+template<typename T, template<typename> class U, template<typename> class W>
 inline bool operator==(scoped_ptr<T, U, W>& left, const T* right) {
     return right == left;
 }
 
-template<typename T, typename U, typename W>
+template<typename T, template<typename> class U, template<typename> class W>
 inline bool operator!=(scoped_ptr<T, U, W>& left, const T* right) {
     return !(right == left);
 }
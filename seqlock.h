@@ -0,0 +1,201 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "cpu_relax.h"
+
+/**
+ * \brief Sequence lock protecting a small, trivially copyable value that is
+ *      read far more often than it is written (counters, clock offsets,
+ *      routing weights). Readers never write to shared memory: load() copies
+ *      the value optimistically and retries if a writer was active at the
+ *      same time, so readers scale with the number of cores. Writers are
+ *      serialized by the sequence counter itself, which is odd while a write
+ *      is in progress.
+ *      The value is stored as an array of relaxed atomic words, so that
+ *      concurrent reads and writes are not data races.
+ * \remarks Readers can be held up by a continuous stream of writers, and
+ *      a writer must not be preempted for long in the middle of a write:
+ *      keep writes short. Writers are not fair.
+ * \see auto_seqlock_writer
+ */
+template<typename T>
+class seqlock {
+public :
+    typedef T               value_type;
+    typedef seqlock<T>      self_t;
+
+private :
+    typedef uintptr_t       word_t;
+
+    enum {
+        word_count = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t)
+    };
+
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "seqlock values must be trivially copyable!");
+
+    /*!< Odd while a writer is active. */
+    alignas(64) std::atomic<unsigned int>   sequence_;
+    std::atomic<word_t>                     words_[word_count];
+
+    void copy_out(T& value) const {
+        word_t buffer[word_count];
+        for (size_t i = 0; i < word_count; ++i)
+            buffer[i] = words_[i].load(std::memory_order_relaxed);
+        std::memcpy(&value, buffer, sizeof(T));
+    }
+
+    void copy_in(const T& value) {
+        word_t buffer[word_count] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+        for (size_t i = 0; i < word_count; ++i)
+            words_[i].store(buffer[i], std::memory_order_relaxed);
+    }
+
+public :
+    seqlock() : sequence_(0) {
+        copy_in(T());
+    }
+
+    explicit seqlock(const T& value) : sequence_(0) {
+        copy_in(value);
+    }
+
+    seqlock(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    /**
+     * \brief Returns a consistent copy of the value.
+     */
+    T load() const {
+        T value;
+        spin_backoff backoff;
+        for (;;) {
+            const unsigned int before = sequence_.load(std::memory_order_acquire);
+            if (!(before & 1)) {
+                copy_out(value);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == before)
+                    return value;
+            }
+            backoff.wait();
+        }
+    }
+
+    /**
+     * \brief Starts a write, waiting for the current writer, if any.
+     * \return The value, for the writer to modify and pass to end_write().
+     */
+    T begin_write() {
+        spin_backoff backoff;
+        unsigned int current = sequence_.load(std::memory_order_relaxed);
+        for (;;) {
+            // Acquire, to see the value published by the previous writer.
+            if (!(current & 1) &&
+                    sequence_.compare_exchange_weak(current, current + 1,
+                                                    std::memory_order_acquire,
+                                                    std::memory_order_relaxed))
+                break;
+            backoff.wait();
+            current = sequence_.load(std::memory_order_relaxed);
+        }
+        // Keeps the stores to the value from moving above the increment.
+        std::atomic_thread_fence(std::memory_order_release);
+
+        T value;
+        copy_out(value);
+        return value;
+    }
+
+    /**
+     * \brief Publishes the value and ends the write started by begin_write().
+     */
+    void end_write(const T& value) {
+        copy_in(value);
+        sequence_.store(sequence_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    }
+
+    /**
+     * \brief Replaces the value.
+     */
+    void store(const T& value) {
+        begin_write();
+        end_write(value);
+    }
+};
+
+/**
+ * \brief Writer guard for a seqlock, in the style of auto_lock: starts a
+ *      write on construction, gives access to a copy of the value, and
+ *      publishes the copy on destruction.
+ * \code
+ *  seqlock<routing_weights> weights;
+ *  {
+ *      auto_seqlock_writer<routing_weights> writer(weights);
+ *      writer->weight_[3] = 10;
+ *  }
+ * \endcode
+ */
+template<typename T>
+class auto_seqlock_writer {
+private :
+    /*!< Reference to the seqlock being written. */
+    seqlock<T>&     lock_;
+    /*!< Value published on destruction. */
+    T               value_;
+
+public :
+    explicit auto_seqlock_writer(seqlock<T>& lock)
+        : lock_(lock), value_(lock.begin_write()) {}
+
+    ~auto_seqlock_writer() {
+        lock_.end_write(value_);
+    }
+
+    auto_seqlock_writer(const auto_seqlock_writer&) = delete;
+    auto_seqlock_writer& operator=(const auto_seqlock_writer&) = delete;
+
+    T* operator->() {
+        return &value_;
+    }
+
+    T& operator*() {
+        return value_;
+    }
+};
@@ -0,0 +1,147 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+/**
+ * \brief Reference counts for objects that do not implement reference
+ *      counting themselves. The block is allocated together with the object
+ *      it counts, immediately before it, so that it can be found from a
+ *      pointer to the object and the pair needs a single allocation. Blocks
+ *      can also be allocated on their own, to hold the counts of an object
+ *      deriving from weak_intrusive_refcount_impl.
+ *
+ *  The object is destroyed when the strong count drops to zero. The memory
+ *  of the block is released when the weak count drops to zero. All the
+ *  strong references together hold one weak reference, so the block
+ *  outlives the object while any weak_pointer refers to it.
+ * \remarks Objects are laid out at an offset of sizeof(shared_control_block)
+ *      from the start of the block, so types requiring a stricter alignment
+ *      than std::max_align_t are not supported.
+ * \see make_shared_pointer, control_block_refcount, control_block_storage,
+ *      weak_pointer
+ */
+struct alignas(std::max_align_t) shared_control_block {
+    /*!< Number of shared_pointer objects referring to the object. */
+    std::atomic<unsigned int>   strong_;
+    /*!< Number of weak_pointer objects, plus one while strong_ is not 0. */
+    std::atomic<unsigned int>   weak_;
+    /*!< Destroys the object placed after the block, if there is one. */
+    void (*destroy_)(shared_control_block*);
+
+    explicit shared_control_block(void (*destroy)(shared_control_block*))
+        : strong_(1), weak_(1), destroy_(destroy) {}
+
+    shared_control_block(const shared_control_block&) = delete;
+    shared_control_block& operator=(const shared_control_block&) = delete;
+
+    /**
+     * \brief Returns the address where the counted object is constructed.
+     */
+    void* object() {
+        return this + 1;
+    }
+
+    /**
+     * \brief Returns the block that counts references to an object created
+     *      by make_shared_pointer.
+     */
+    static shared_control_block* of(const void* obj) {
+        return static_cast<shared_control_block*>(const_cast<void*>(obj)) - 1;
+    }
+
+    /**
+     * \brief Allocates a block with enough room for an object of type T.
+     *      The object itself is not constructed.
+     */
+    template<typename T>
+    static shared_control_block* allocate() {
+        static_assert(alignof(T) <= alignof(shared_control_block),
+                      "Over-aligned types are not supported!");
+        void* memory = ::operator new(sizeof(shared_control_block) + sizeof(T));
+        return new (memory) shared_control_block(&destroy<T>);
+    }
+
+    /**
+     * \brief Allocates a block that is not followed by an object.
+     */
+    static shared_control_block* allocate_detached() {
+        void* memory = ::operator new(sizeof(shared_control_block));
+        return new (memory) shared_control_block(nullptr);
+    }
+
+    /**
+     * \brief Releases a block whose object was never constructed or has
+     *      already been destroyed.
+     */
+    static void deallocate(shared_control_block* block) {
+        block->~shared_control_block();
+        ::operator delete(block);
+    }
+
+    /**
+     * \brief Takes a strong reference, unless the object has already been
+     *      destroyed. Never blocks.
+     * \return True if a reference was taken.
+     */
+    bool try_add_ref() {
+        unsigned int count = strong_.load(std::memory_order_relaxed);
+        while (count != 0) {
+            if (strong_.compare_exchange_weak(count, count + 1,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    void add_weak_ref() {
+        weak_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Drops a weak reference, releasing the block if it was the last.
+     */
+    void release_weak_ref() {
+        if (weak_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            deallocate(this);
+    }
+
+private :
+    template<typename T>
+    static void destroy(shared_control_block* block) {
+        static_cast<T*>(block->object())->~T();
+    }
+};
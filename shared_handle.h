@@ -31,15 +31,19 @@
 
 #pragma once
 
+#include "handle_ownership.h"
 #include "handle_traits.h"
 
 /**
  *\brief Allows automatic management and sharing of a resource (socket, file
- *  descriptor, mutex, etc.). This class implements a form of reference counting
- *  using a circular double linked list. Each shared_handle object is a node in
- *  the circular double linked list, all nodes in a list referring to the same
- *  resource. When the last node in the list is deleted, the resource is also
- *  destroyed (since there are no more outstanding references to it).
+ *  descriptor, mutex, etc.). The shared_handle objects referring to the same
+ *  resource are tracked by the ownership_policy. When the last of them is
+ *  destroyed, the resource is also destroyed (since there are no more
+ *  outstanding references to it). The default policy, linked_ownership,
+ *  implements a form of reference counting using a circular double linked
+ *  list, each shared_handle object being a node in the list. The
+ *  counted_ownership policy uses an atomic counter instead, so that copies
+ *  can be made and destroyed from different threads.
  *\remarks The management_policy template parameter must define the following :
  *  - null_handle() which returns a value representing an invalid handle (for
  *      example -1 for posix file descriptor/socket or INVALID_HANDLE_VALUE for
@@ -51,26 +55,21 @@
  *      reference to a resource. The handle_traits_base class can be used to
  *      help defining those members, by inheriting from it and overriding the
  *      default template arguments, where necessary.
- *\sa handle_traits_base
+ *\sa handle_traits_base, linked_ownership, counted_ownership
  */
-template<typename management_policy>
-class shared_handle {
+template<
+        typename management_policy,
+        template<typename> class ownership_policy = linked_ownership
+> class shared_handle : private ownership_policy<management_policy> {
 public :
     typedef management_policy                           mpolicy_t;
+    typedef ownership_policy<management_policy>         opolicy_t;
     typedef typename mpolicy_t::handle_t                handle_t;
     typedef typename mpolicy_t::handle_ptr_t            handle_ptr_t;
     typedef typename mpolicy_t::handle_ref_t            handle_ref_t;
     typedef typename mpolicy_t::handle_const_ref_t      handle_const_ref_t;
-    typedef shared_handle<management_policy>            self_t;
+    typedef shared_handle<management_policy, ownership_policy>  self_t;
 private :
-    /**
-     * \brief Pointer to the next node in the list.
-     */
-    mutable self_t*     next_;
-    /**
-     * \brief Pointer to the previous node in the list.
-     */
-    mutable self_t*     prev_;
     /**
      * \brief The shared resource.
      */
@@ -80,36 +79,12 @@ private :
         int member;
     };
 
-    /**
-     * \brief Initialize by making a circular reference to this node.
-     */
-    void initialize() {
-        this->next_ = this->prev_ = this;
-    }
-
-    /**
-     * \brief Adds this object to the list of objects that share the handle.
-     * \param other Pointer to the previous node in the object list.
-     */
-    void initialize(self_t* other) {
-        other->next_->prev_ = this;
-        this->next_ = other->next_;
-        other->next_ = this;
-        this->prev_ = other;
+    opolicy_t& owners() {
+        return *this;
     }
 
-    /**
-     * \brief Remove this node from the list of nodes that share
-     *  the same handle.
-     * \return True if this node is the only node in the list (in which case
-     *  the owned resource will be destructed when this object expires).
-     * \remarks The next_ and prev_ pointers are not updated, since erase()
-     *  is called either at the node's destruction or at assignment.
-     */
-    bool erase() {
-        this->prev_->next_ = this->next_;
-        this->next_->prev_ = this->prev_;
-        return (next_ == this) && (prev_ == this);
+    const opolicy_t& owners() const {
+        return *this;
     }
 
     /**
@@ -120,26 +95,11 @@ private :
         // Steal the handle and sink rval.
         handle_ = rval.handle_;
         rval.handle_ = mpolicy_t::null_handle();
-        //
-        // Replace the rval node in the existing list. We save the next_ pointer,
-        // since in the case when it points to rval it becomes an alias for
-        // the this pointer, after the first assignment is executed.
-        self_t* tmpVal = rval.next_;
-        //
-        // Replace the pointers to the nodes that where linked to rval with
-        // pointers to ourselves.
-        rval.prev_->next_ = this;
-        tmpVal->prev_ = this;
-
-        //
-        // Update our links and make rval to refer to itself.
-        next_ = rval.next_;
-        prev_ = rval.prev_;
-        rval.prev_ = rval.next_ = &rval;
+        owners().steal(rval.owners());
     }
 
     bool has_one_ref() const {
-        return (prev_ == this) && (next_ == this);
+        return owners().unique(handle_);
     }
 
     handle_t get() const {
@@ -148,53 +108,22 @@ private :
 
     void reset(handle_t newHandle) {
         if (newHandle != handle_) {
-            if (erase()) {
+            if (owners().release(handle_))
                 mpolicy_t::dispose(handle_);
-            } else {
-                //
-                // Make this node refer to itself since erase() does not update
-                // the previous and next links.
-                initialize();
-            }
             handle_ = newHandle;
+            owners().initialize(handle_);
         }
     }
 
     handle_ptr_t get_impl() {
-        if (!has_one_ref()) {
-            erase();
-            initialize();
-        } else {
+        if (owners().release(handle_))
             mpolicy_t::dispose(handle_);
-        }
+        owners().initialize_for_output();
         return &handle_;
     }
 
     void swap(self_t& other) {
-        //
-        // Save the next pointer, to avoid becoming an alias for &other.
-        // This happens when this node references itself.
-        self_t* saveRegOne = this->next_;
-        this->prev_->next_ = &other;
-        saveRegOne->prev_ = &other;
-
-        //
-        // See remarks for saveRegOne.
-        self_t* saveRegTwo = other.next_;
-        other.prev_->next_ = this;
-        saveRegTwo->prev_ = this;
-
-        //
-        // Save old links since we need them to fix the other node.
-        saveRegOne = this->prev_;
-        saveRegTwo = this->next_;
-
-        this->prev_ = other.prev_;
-        this->next_ = other.next_;
-
-        other.prev_ = saveRegOne;
-        other.next_ = saveRegTwo;
-
+        owners().swap(other.owners());
         std::swap(this->handle_, other.handle_);
     }
 
@@ -203,7 +132,7 @@ public :
      * \brief Initialize with a null handle.
      */
     shared_handle() : handle_(mpolicy_t::null_handle()) {
-        initialize();
+        owners().initialize(handle_);
     }
 
     /**
@@ -211,25 +140,25 @@ public :
      * \param Existing handle.
      */
     explicit shared_handle(handle_t newHandle) : handle_(newHandle) {
-        initialize();
+        owners().initialize(handle_);
     }
 
     /**
      * \brief Share ownership with another shared_handle object.
      */
-    shared_handle(const self_t& other) : handle_(other.handle_) {
-        initialize(const_cast<self_t*>(&other));
+    shared_handle(const self_t& other) : opolicy_t(), handle_(other.handle_) {
+        owners().share(other.owners(), handle_);
     }
 
     /**
      * \brief Construct from a rvalue of this type.
      */
-    shared_handle(self_t&& other) {
+    shared_handle(self_t&& other) : opolicy_t() {
         steal_from_rvalue(std::forward<self_t&&>(other));
     }
 
     ~shared_handle() {
-        if (erase())
+        if (owners().release(handle_))
             mpolicy_t::dispose(handle_);
     }
 
@@ -287,6 +216,15 @@ public :
         return sh.get_impl();
     }
 
+    /**
+     * \brief Returns the number of shared_handle objects referring to the
+     *  same handle as sh. O(1) with counted_ownership, O(n) with
+     *  linked_ownership.
+     */
+    friend inline size_t shared_handle_use_count(const self_t& sh) {
+        return sh.owners().use_count(sh.handle_);
+    }
+
     /**
      * \brief Swap the contents of two shared_handle objects.
      */
@@ -301,30 +239,24 @@ public :
     }
 
     size_t refcount() const {
-        const self_t* head = next_;
-        size_t count = 1;
-        while (head != this) {
-            head = head->next_;
-            ++count;
-        }
-        return count;
+        return owners().use_count(handle_);
     }
 
 #endif
 
     self_t& operator=(const self_t& other) {
         if (this != &other) {
-            if (erase())
+            if (owners().release(handle_))
                 mpolicy_t::dispose(handle_);
             handle_ = other.handle_;
-            initialize(const_cast<self_t*>(&other));
+            owners().share(other.owners(), handle_);
         }
         return *this;
     }
 
     self_t& operator=(self_t&& other) {
         if (this != &other) {
-            if (erase())
+            if (owners().release(handle_))
                 mpolicy_t::dispose(handle_);
             steal_from_rvalue(std::forward<self_t&&>(other));
         }
@@ -332,38 +264,38 @@ public :
     }
 };
 
-template<typename T>
-inline bool operator==(const shared_handle<T>& left,
-                       const shared_handle<T>& right) {
+template<typename T, template<typename> class O>
+inline bool operator==(const shared_handle<T, O>& left,
+                       const shared_handle<T, O>& right) {
     return shared_handle_get(left) == shared_handle_get(right);
 }
 
-template<typename T>
-inline bool operator!=(const shared_handle<T>& left,
-                       const shared_handle<T>& right) {
+template<typename T, template<typename> class O>
+inline bool operator!=(const shared_handle<T, O>& left,
+                       const shared_handle<T, O>& right) {
     return !(left == right);
 }
 
-template<typename T>
+template<typename T, template<typename> class O>
 inline bool operator==(const typename T::handle_t& left,
-                       const shared_handle<T>& right) {
+                       const shared_handle<T, O>& right) {
     return left == shared_handle_get(right);
 }
 
-template<typename T>
+template<typename T, template<typename> class O>
 inline bool operator!=(const typename T::handle_t& left,
-                       const shared_handle<T>& right) {
+                       const shared_handle<T, O>& right) {
     return !(left == right);
 }
 
-template<typename T>
-inline bool operator==(const shared_handle<T>& left,
+template<typename T, template<typename> class O>
+inline bool operator==(const shared_handle<T, O>& left,
                        const typename T::handle_t& right) {
     return right == left;
 }
 
-template<typename T>
-inline bool operator!=(const shared_handle<T>& left,
+template<typename T, template<typename> class O>
+inline bool operator!=(const shared_handle<T, O>& left,
                        const typename T::handle_t& right) {
     return !(right == left);
 }
@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "fd_refcount_table.h"
 #include "shared_handle.h"
 
 struct fake_fd_policy : public handle_traits_base<int> {
@@ -173,3 +176,116 @@ TEST(shared_handle, correctness_assign) {
     EXPECT_EQ(2, tracer::get_constructed_count());
     EXPECT_EQ(2, tracer::get_destroyed_count());
 }
+
+typedef shared_handle<fake_fd_policy, counted_ownership> counted_handle_t;
+typedef shared_handle<tracer_policy, counted_ownership> counted_tracer_t;
+
+TEST(shared_handle_counted, use_count) {
+    counted_handle_t sh1(1);
+    EXPECT_EQ(1, shared_handle_use_count(sh1));
+    EXPECT_TRUE(sh1.shouldBeErased());
+
+    {
+        counted_handle_t sh2(sh1);
+        counted_handle_t sh3;
+        sh3 = sh2;
+        EXPECT_EQ(3, shared_handle_use_count(sh1));
+        EXPECT_EQ(3, shared_handle_use_count(sh3));
+
+        counted_handle_t sh4(std::move(sh3));
+        EXPECT_FALSE(sh3);
+        EXPECT_EQ(3, shared_handle_use_count(sh4));
+    }
+
+    EXPECT_EQ(1, shared_handle_use_count(sh1));
+}
+
+TEST(shared_handle_counted, swap_and_reset) {
+    counted_handle_t shA(1);
+    counted_handle_t shA2(shA);
+    counted_handle_t shB(2);
+
+    swap(shA2, shB);
+    EXPECT_EQ(2, shared_handle_get(shA2));
+    EXPECT_EQ(1, shared_handle_use_count(shA2));
+    EXPECT_EQ(1, shared_handle_get(shB));
+    EXPECT_EQ(2, shared_handle_use_count(shB));
+
+    shared_handle_reset(shB, 5);
+    EXPECT_EQ(1, shared_handle_use_count(shA));
+    EXPECT_EQ(5, shared_handle_get(shB));
+}
+
+TEST(shared_handle_counted, correctness_across_threads) {
+    tracer::reset_statitstics();
+    {
+        counted_tracer_t st(tracer::mk_tracer(1));
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 4; ++i) {
+            workers.push_back(std::thread([&st]() {
+                for (int j = 0; j < 10000; ++j) {
+                    counted_tracer_t copy(st);
+                    counted_tracer_t other;
+                    other = copy;
+                }
+            }));
+        }
+
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+
+        EXPECT_EQ(1, shared_handle_use_count(st));
+        EXPECT_EQ(0, tracer::get_destroyed_count());
+    }
+
+    EXPECT_EQ(1, tracer::get_constructed_count());
+    EXPECT_EQ(1, tracer::get_destroyed_count());
+}
+
+typedef shared_handle<fake_fd_policy, fd_table_ownership> table_handle_t;
+
+static_assert(sizeof(table_handle_t) == sizeof(int),
+              "fd_table_ownership must not add to the size of a handle!");
+
+TEST(shared_handle_fd_table, use_count) {
+    table_handle_t sh1(40);
+    EXPECT_EQ(1, shared_handle_use_count(sh1));
+
+    {
+        table_handle_t sh2(sh1);
+        table_handle_t sh3;
+        sh3 = sh2;
+        EXPECT_EQ(3, shared_handle_use_count(sh1));
+        EXPECT_FALSE(sh3.shouldBeErased());
+
+        table_handle_t sh4(std::move(sh3));
+        EXPECT_FALSE(sh3);
+        EXPECT_EQ(3, shared_handle_use_count(sh4));
+    }
+
+    EXPECT_EQ(1, shared_handle_use_count(sh1));
+    EXPECT_TRUE(sh1.shouldBeErased());
+}
+
+TEST(shared_handle_fd_table, release_across_threads) {
+    {
+        table_handle_t sh(41);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 4; ++i) {
+            workers.push_back(std::thread([&sh]() {
+                for (int j = 0; j < 10000; ++j) {
+                    table_handle_t copy(sh);
+                    EXPECT_FALSE(copy.shouldBeErased());
+                }
+            }));
+        }
+
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+
+        EXPECT_EQ(1, shared_handle_use_count(sh));
+    }
+
+    table_handle_t reused(41);
+    EXPECT_EQ(1, shared_handle_use_count(reused));
+}
@@ -31,6 +31,8 @@
 
 #pragma once
 
+#include <type_traits>
+#include <utility>
 #include "pointer_policies.h"
 
 template<
@@ -51,15 +53,49 @@ public :
     typedef T&                                                  ref_t;
     typedef const T&                                            const_ref_t;
 
+    enum {
+        /*!< The count lives in a shared_control_block before the object. */
+        uses_control_block =
+            std::is_same<refpolicy_t, control_block_refcount<T> >::value
+    };
+
+    static_assert(uses_control_block ==
+                  std::is_same<spolicy_t, control_block_storage<T> >::value,
+                  "control_block_refcount and control_block_storage must be "
+                  "used together!");
+
+    static_assert(!std::is_same<refpolicy_t, biased_refcount<T> >::value ||
+                  std::is_same<spolicy_t, default_storage<T> >::value,
+                  "biased_refcount destroys merged objects with delete, it "
+                  "must be used with default_storage!");
+
 private :
     T*  pointee_;
 
+    /**
+     * \brief Converts a pointer from a shared_pointer to U. The control block
+     *      of an object is found from its address, so with
+     *      control_block_refcount the T subobject must be at offset 0 in U,
+     *      which is only guaranteed for standard layout types.
+     */
+    template<typename U>
+    static T* convert(U* ptr) {
+        static_assert(!uses_control_block ||
+                      std::is_same<typename std::remove_cv<U>::type,
+                                   typename std::remove_cv<T>::type>::value ||
+                      std::is_standard_layout<U>::value,
+                      "With control_block_refcount, only standard layout "
+                      "types can be converted to a base class pointer!");
+        return ptr;
+    }
+
     struct helper_t {
         int member;
     };
 
     T* get() const {
         checkpolicy_t::check_ptr(pointee_);
+        return pointee_;
     }
 
     T* release() {
@@ -106,7 +142,7 @@ public :
     shared_pointer(const shared_pointer<U, reference_policy,
                                         storage_policy,
                                         checking_policy>& right) {
-        pointee_ = shared_ptr_get(right);
+        pointee_ = convert(shared_ptr_get(right));
         refpolicy_t::add_ref(pointee_);
     }
 
@@ -117,8 +153,8 @@ public :
         typedef shared_pointer<
                 U, reference_policy, storage_policy, checking_policy
                 > convertible_rval_t;
-        pointee_ = shared_ptr_release(
-                    std::forward<convertible_rval_t&&>(right));
+        pointee_ = convert(shared_ptr_release(
+                               std::forward<convertible_rval_t&&>(right)));
     }
 
     self_t& operator=(const self_t& right) {
@@ -142,10 +178,11 @@ public :
     self_t& operator=(const shared_pointer<U, reference_policy,
                                            storage_policy,
                                            checking_policy>& right) {
-        refpolicy_t::add_ref(shared_ptr_get(right));
+        T* other = convert(shared_ptr_get(right));
+        refpolicy_t::add_ref(other);
         if (refpolicy_t::dec_ref(pointee_))
             spolicy_t::dispose(pointee_);
-        pointee_ = shared_ptr_get(right);
+        pointee_ = other;
         return *this;
     }
 
@@ -158,8 +195,8 @@ public :
 
         if (refpolicy_t::dec_ref(pointee_))
             spolicy_t::dispose(pointee_);
-        pointee_ = shared_ptr_release(
-                    std::forward<convertible_rval_t&&>(right));
+        pointee_ = convert(shared_ptr_release(
+                               std::forward<convertible_rval_t&&>(right)));
         return *this;
     }
 
@@ -207,61 +244,36 @@ public :
     }
 };
 
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator==(
-        const shared_pointer<T, RP, SP, CP>& left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return shared_ptr_get(left) == shared_ptr_get(right);
-}
-
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator!=(
-        const shared_pointer<T, RP, SP, CP>& left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return !(left == right);
-}
-
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator==(
-        const shared_pointer<T, RP, SP, CP>& left,
-        const T* right
-        )
-{
-    return shared_ptr_get(left) == right;
-}
-
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator==(
-        const T* left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return right == left;
-}
+/**
+ * \brief Creates an object of type T that can be shared without implementing
+ *      reference counting itself. The object and its reference count are
+ *      placed in a single allocation.
+ * \param args Arguments forwarded to the constructor of T.
+ * \return A shared_pointer owning the new object.
+ * \see shared_control_block
+ */
+template<typename T, typename... Args>
+inline shared_pointer<T, control_block_refcount, control_block_storage>
+make_shared_pointer(Args&&... args) {
+    shared_control_block* block = shared_control_block::allocate<T>();
+    T* obj;
+    try {
+        obj = new (block->object()) T(std::forward<Args>(args)...);
+    } catch (...) {
+        shared_control_block::deallocate(block);
+        throw;
+    }
 
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator!=(
-        const shared_pointer<T, RP, SP, CP>& left,
-        const T* right
-        )
-{
-    return !(left == right);
+    return shared_pointer<T, control_block_refcount, control_block_storage>(
+                obj);
 }
 
-template<typename T, typename RP, typename SP, typename CP>
-inline bool operator!=(
-        const T* left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return !(right == left);
-}
+#define SHARED_POINTER_TEMPLATE_ARGS \
+    template<typename> class RP, \
+    template<typename> class SP, \
+    template<typename> class CP
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator==(
         const shared_pointer<T, RP, SP, CP>& left,
         const shared_pointer<U, RP, SP, CP>& right
@@ -270,16 +282,7 @@ inline bool operator==(
     return shared_ptr_get(left) == shared_ptr_get(right);
 }
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
-inline bool operator==(
-        const shared_pointer<U, RP, SP, CP>& left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return right == left;
-}
-
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator!=(
         const shared_pointer<T, RP, SP, CP>& left,
         const shared_pointer<U, RP, SP, CP>& right
@@ -288,47 +291,40 @@ inline bool operator!=(
     return !(left == right);
 }
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
-inline bool operator!=(
-        const shared_pointer<U, RP, SP, CP>& left,
-        const shared_pointer<T, RP, SP, CP>& right
-        )
-{
-    return !(right == left);
-}
-
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator==(
-        const shared_pointer<U, RP, SP, CP>& left,
+        const shared_pointer<T, RP, SP, CP>& left,
         const U* right
         )
 {
     return shared_ptr_get(left) == right;
 }
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator==(
         const U* left,
-        const shared_pointer<U, RP, SP, CP>& right
+        const shared_pointer<T, RP, SP, CP>& right
         )
 {
     return right == left;
 }
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator!=(
-        const shared_pointer<U, RP, SP, CP>& left,
+        const shared_pointer<T, RP, SP, CP>& left,
         const U* right
         )
 {
     return !(left == right);
 }
 
-template<typename T, typename U, typename RP, typename SP, typename CP>
+template<typename T, typename U, SHARED_POINTER_TEMPLATE_ARGS>
 inline bool operator!=(
         const U* left,
-        const shared_pointer<U, RP, SP, CP>& right
+        const shared_pointer<T, RP, SP, CP>& right
         )
 {
     return !(right == left);
 }
+
+#undef SHARED_POINTER_TEMPLATE_ARGS
@@ -0,0 +1,476 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "atomic_shared_pointer.h"
+#include "epoch_reclamation.h"
+#include "shared_pointer.h"
+#include "weak_pointer.h"
+
+struct counted_object : public intrusive_refcount_impl {
+    static unsigned int destroyed_;
+
+    int value_;
+
+    explicit counted_object(int value) : value_(value) {}
+
+    ~counted_object() {
+        ++destroyed_;
+    }
+};
+
+unsigned int counted_object::destroyed_ = 0;
+
+struct atomic_counted_object : public atomic_intrusive_refcount_impl {
+    static std::atomic<unsigned int> destroyed_;
+
+    int value_;
+
+    explicit atomic_counted_object(int value) : value_(value) {}
+
+    ~atomic_counted_object() {
+        ++destroyed_;
+    }
+};
+
+std::atomic<unsigned int> atomic_counted_object::destroyed_(0);
+
+struct biased_counted_object : public biased_refcount_impl {
+    static std::atomic<unsigned int> destroyed_;
+
+    int value_;
+
+    explicit biased_counted_object(int value) : value_(value) {}
+
+    ~biased_counted_object() {
+        ++destroyed_;
+    }
+};
+
+std::atomic<unsigned int> biased_counted_object::destroyed_(0);
+
+struct plain_object {
+    static std::atomic<unsigned int> destroyed_;
+
+    int first_;
+    double second_;
+
+    plain_object(int first, double second) : first_(first), second_(second) {}
+
+    ~plain_object() {
+        ++destroyed_;
+    }
+};
+
+std::atomic<unsigned int> plain_object::destroyed_(0);
+
+struct weak_counted_object : public weak_intrusive_refcount_impl {
+    static unsigned int destroyed_;
+
+    int value_;
+
+    explicit weak_counted_object(int value) : value_(value) {}
+
+    ~weak_counted_object() {
+        ++destroyed_;
+    }
+};
+
+unsigned int weak_counted_object::destroyed_ = 0;
+
+typedef shared_pointer<counted_object> counted_ptr_t;
+typedef shared_pointer<
+    atomic_counted_object, atomic_intrusive_refcount
+> atomic_counted_ptr_t;
+typedef shared_pointer<
+    biased_counted_object, biased_refcount
+> biased_counted_ptr_t;
+
+TEST(shared_pointer, intrusive_copy_and_release) {
+    counted_object::destroyed_ = 0;
+    {
+        counted_ptr_t sp1(new counted_object(1));
+        {
+            counted_ptr_t sp2(sp1);
+            counted_ptr_t sp3;
+            sp3 = sp2;
+            EXPECT_TRUE(sp1 == sp3);
+            EXPECT_EQ(1, sp3->value_);
+        }
+        EXPECT_EQ(0u, counted_object::destroyed_);
+    }
+    EXPECT_EQ(1u, counted_object::destroyed_);
+}
+
+TEST(shared_pointer, atomic_refcount_across_threads) {
+    atomic_counted_object::destroyed_ = 0;
+    {
+        atomic_counted_ptr_t sp(new atomic_counted_object(7));
+        std::vector<std::thread> workers;
+        for (int i = 0; i < 4; ++i) {
+            workers.push_back(std::thread([&sp]() {
+                for (int j = 0; j < 10000; ++j) {
+                    atomic_counted_ptr_t copy(sp);
+                    EXPECT_EQ(7, copy->value_);
+                }
+            }));
+        }
+
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+
+        EXPECT_EQ(1u, shared_ptr_get(sp)->use_count());
+        EXPECT_EQ(0u, atomic_counted_object::destroyed_.load());
+    }
+    EXPECT_EQ(1u, atomic_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, biased_refcount_owner_releases_last) {
+    biased_counted_object::destroyed_ = 0;
+    {
+        biased_counted_ptr_t sp(new biased_counted_object(3));
+        std::thread worker([&sp]() {
+            for (int i = 0; i < 1000; ++i) {
+                biased_counted_ptr_t copy(sp);
+                EXPECT_EQ(3, copy->value_);
+            }
+        });
+        worker.join();
+        EXPECT_EQ(0u, biased_counted_object::destroyed_.load());
+    }
+    EXPECT_EQ(1u, biased_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, biased_refcount_queued_merge) {
+    biased_counted_object::destroyed_ = 0;
+    {
+        biased_counted_ptr_t sp(new biased_counted_object(5));
+        biased_counted_ptr_t handed_off(sp);
+
+        //
+        // Dropping a reference created by the owner on another thread
+        // drives the shared count negative and queues the object.
+        std::thread worker([&handed_off]() {
+            biased_counted_ptr_t local(std::move(handed_off));
+        });
+        worker.join();
+
+        biased_refcount_impl::merge_queued();
+        EXPECT_EQ(0u, biased_counted_object::destroyed_.load());
+    }
+    EXPECT_EQ(1u, biased_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, biased_refcount_owner_exits_first) {
+    biased_counted_object::destroyed_ = 0;
+    biased_counted_ptr_t survivor;
+
+    std::thread owner([&survivor]() {
+        biased_counted_ptr_t sp(new biased_counted_object(9));
+        survivor = sp;
+    });
+    owner.join();
+
+    EXPECT_EQ(9, survivor->value_);
+    shared_ptr_reset(survivor);
+    EXPECT_EQ(1u, biased_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, biased_refcount_owner_releases_after_exit) {
+    biased_counted_object::destroyed_ = 0;
+
+    //
+    // Thread locals are destroyed in reverse order of construction: the
+    // holder is constructed after the record that closes the owner queue,
+    // so it releases its pointer on the owner thread after the queue closed.
+    struct holder {
+        biased_counted_ptr_t sp_;
+    };
+
+    std::thread owner([]() {
+        static thread_local holder late;
+        biased_counted_ptr_t sp(new biased_counted_object(11));
+        late.sp_ = sp;
+    });
+    owner.join();
+
+    EXPECT_EQ(1u, biased_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, biased_refcount_created_during_exit) {
+    biased_counted_object::destroyed_ = 0;
+
+    struct creator {
+        ~creator() {
+            biased_counted_ptr_t sp(new biased_counted_object(12));
+            biased_counted_ptr_t copy(sp);
+        }
+    };
+
+    std::thread owner([]() {
+        static thread_local creator late;
+        (void)late;
+        biased_counted_ptr_t sp(new biased_counted_object(13));
+    });
+    owner.join();
+
+    EXPECT_EQ(2u, biased_counted_object::destroyed_.load());
+}
+
+TEST(shared_pointer, make_shared_pointer_single_allocation) {
+    plain_object::destroyed_ = 0;
+    {
+        shared_pointer<plain_object, control_block_refcount,
+                       control_block_storage> sp =
+                make_shared_pointer<plain_object>(4, 2.5);
+        EXPECT_EQ(4, sp->first_);
+        EXPECT_EQ(2.5, sp->second_);
+
+        shared_control_block* block =
+                shared_control_block::of(shared_ptr_get(sp));
+        EXPECT_EQ(static_cast<void*>(shared_ptr_get(sp)), block->object());
+        EXPECT_EQ(1u, block->strong_.load());
+
+        {
+            shared_pointer<plain_object, control_block_refcount,
+                           control_block_storage> copy(sp);
+            EXPECT_EQ(2u, block->strong_.load());
+        }
+        EXPECT_EQ(1u, block->strong_.load());
+        EXPECT_EQ(0u, plain_object::destroyed_.load());
+    }
+    EXPECT_EQ(1u, plain_object::destroyed_.load());
+}
+
+namespace {
+
+struct tag_base {};
+
+struct tagged_value : public tag_base {
+    static unsigned int destroyed_;
+
+    int value_;
+
+    explicit tagged_value(int value) : value_(value) {}
+
+    ~tagged_value() {
+        ++destroyed_;
+    }
+};
+
+unsigned int tagged_value::destroyed_ = 0;
+
+} // anonymous namespace
+
+TEST(shared_pointer, control_block_base_conversion) {
+    static_assert(std::is_standard_layout<tagged_value>::value,
+                  "base subobject must be at offset 0");
+    tagged_value::destroyed_ = 0;
+    {
+        shared_pointer<tag_base, control_block_refcount,
+                       control_block_storage> base =
+                make_shared_pointer<tagged_value>(8);
+        EXPECT_EQ(1u, shared_control_block::of(shared_ptr_get(base))->
+                  strong_.load());
+    }
+    // Destroyed through the block, with the destructor of tagged_value.
+    EXPECT_EQ(1u, tagged_value::destroyed_);
+}
+
+TEST(weak_pointer, intrusive_lock_and_expire) {
+    weak_counted_object::destroyed_ = 0;
+    weak_pointer<weak_counted_object> wp;
+    EXPECT_TRUE(weak_ptr_expired(wp));
+    EXPECT_FALSE(weak_ptr_lock(wp));
+
+    {
+        shared_pointer<weak_counted_object, weak_intrusive_refcount> sp(
+                    new weak_counted_object(11));
+        wp = sp;
+        EXPECT_FALSE(weak_ptr_expired(wp));
+
+        shared_pointer<weak_counted_object, weak_intrusive_refcount> locked =
+                weak_ptr_lock(wp);
+        EXPECT_TRUE(locked == sp);
+        EXPECT_EQ(11, locked->value_);
+    }
+
+    EXPECT_EQ(1u, weak_counted_object::destroyed_);
+    EXPECT_TRUE(weak_ptr_expired(wp));
+    EXPECT_FALSE(weak_ptr_lock(wp));
+}
+
+TEST(weak_pointer, control_block_outlives_object) {
+    typedef shared_pointer<
+        plain_object, control_block_refcount, control_block_storage
+    > plain_ptr_t;
+    typedef weak_pointer<
+        plain_object, control_block_refcount, control_block_storage
+    > weak_plain_ptr_t;
+
+    plain_object::destroyed_ = 0;
+    weak_plain_ptr_t wp1;
+    {
+        plain_ptr_t sp = make_shared_pointer<plain_object>(1, 1.0);
+        wp1 = sp;
+        weak_plain_ptr_t wp2(wp1);
+        EXPECT_EQ(3u, shared_control_block::of(shared_ptr_get(sp))->weak_);
+        EXPECT_EQ(1, weak_ptr_lock(wp2)->first_);
+    }
+
+    EXPECT_EQ(1u, plain_object::destroyed_.load());
+    EXPECT_TRUE(weak_ptr_expired(wp1));
+    EXPECT_FALSE(weak_ptr_lock(wp1));
+}
+
+TEST(shared_pointer, epoch_storage_defers_destruction) {
+    typedef shared_pointer<
+        atomic_counted_object, atomic_intrusive_refcount, epoch_storage
+    > epoch_ptr_t;
+
+    atomic_counted_object::destroyed_ = 0;
+    epoch_ptr_t sp(new atomic_counted_object(21));
+    const atomic_counted_object* raw = shared_ptr_get(sp);
+
+    std::atomic<int> stage(0);
+    std::thread reader([&stage, raw]() {
+        epoch_guard guard;
+        stage = 1;
+        while (stage.load() != 2)
+            std::this_thread::yield();
+        EXPECT_EQ(21, raw->value_);
+    });
+
+    while (stage.load() != 1)
+        std::this_thread::yield();
+
+    shared_ptr_reset(sp);
+    EXPECT_EQ(0u, atomic_counted_object::destroyed_.load());
+
+    stage = 2;
+    reader.join();
+    epoch_domain::instance().synchronize();
+    EXPECT_EQ(1u, atomic_counted_object::destroyed_.load());
+}
+
+namespace {
+
+std::atomic<unsigned int> retired_nodes_destroyed(0);
+
+/**
+ * \brief Retired object whose deleter retires its child, as objects that
+ *  own an atomic_shared_pointer do.
+ */
+struct retiring_node {
+    retiring_node* child_;
+
+    static void destroy(void* ptr) {
+        retiring_node* node = static_cast<retiring_node*>(ptr);
+        if (node->child_)
+            epoch_domain::instance().retire(node->child_, &destroy);
+        delete node;
+        ++retired_nodes_destroyed;
+    }
+};
+
+} // anonymous namespace
+
+TEST(epoch_domain, deleters_may_retire) {
+    retired_nodes_destroyed = 0;
+    for (int i = 0; i < 500; ++i) {
+        retiring_node* child = new retiring_node();
+        child->child_ = nullptr;
+        retiring_node* parent = new retiring_node();
+        parent->child_ = child;
+        epoch_domain::instance().retire(parent, &retiring_node::destroy);
+    }
+    epoch_domain::instance().synchronize();
+    EXPECT_EQ(1000u, retired_nodes_destroyed.load());
+}
+
+TEST(atomic_shared_pointer, requires_thread_safe_policy) {
+    static_assert(std::is_same<
+                      atomic_shared_pointer<atomic_counted_object>::refpolicy_t,
+                      atomic_intrusive_refcount<atomic_counted_object>
+                  >::value, "the default policy should be atomic");
+    static_assert(!reference_policy_is_thread_safe<
+                      intrusive_refcount<counted_object> >::value,
+                  "intrusive_refcount is not thread safe");
+    static_assert(reference_policy_is_thread_safe<
+                      biased_refcount<biased_counted_object> >::value,
+                  "biased_refcount is thread safe");
+
+    atomic_counted_object::destroyed_ = 0;
+    {
+        atomic_shared_pointer<atomic_counted_object> slot(
+                    atomic_counted_ptr_t(new atomic_counted_object(4)));
+        EXPECT_EQ(4, slot.load()->value_);
+    }
+    epoch_domain::instance().synchronize();
+    EXPECT_EQ(1u, atomic_counted_object::destroyed_.load());
+}
+
+TEST(atomic_shared_pointer, compare_exchange) {
+    typedef atomic_shared_pointer<
+        atomic_counted_object, atomic_intrusive_refcount
+    > atomic_slot_t;
+
+    atomic_counted_object::destroyed_ = 0;
+    {
+        atomic_counted_ptr_t first(new atomic_counted_object(1));
+        atomic_counted_ptr_t second(new atomic_counted_object(2));
+        atomic_slot_t slot(first);
+
+        atomic_counted_ptr_t expected(second);
+        EXPECT_FALSE(slot.compare_exchange(expected, second));
+        EXPECT_TRUE(expected == first);
+
+        EXPECT_TRUE(slot.compare_exchange(expected, second));
+        EXPECT_TRUE(slot.load() == second);
+
+        atomic_counted_ptr_t previous =
+                slot.exchange(atomic_counted_ptr_t(new atomic_counted_object(3)));
+        EXPECT_TRUE(previous == second);
+        EXPECT_EQ(3, slot.load()->value_);
+    }
+
+    epoch_domain::instance().synchronize();
+    EXPECT_EQ(3u, atomic_counted_object::destroyed_.load());
+}
+
+TEST(atomic_shared_pointer, concurrent_load_and_store) {
+    typedef atomic_shared_pointer<
+        atomic_counted_object, atomic_intrusive_refcount
+    > atomic_slot_t;
+
+    const int kStores = 2000;
+    atomic_counted_object::destroyed_ = 0;
+    {
+        atomic_slot_t slot(atomic_counted_ptr_t(new atomic_counted_object(0)));
+        std::atomic<bool> done(false);
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i) {
+            readers.push_back(std::thread([&slot, &done]() {
+                int last = 0;
+                while (!done.load()) {
+                    atomic_counted_ptr_t current = slot.load();
+                    EXPECT_LE(last, current->value_);
+                    last = current->value_;
+                }
+            }));
+        }
+
+        for (int i = 1; i <= kStores; ++i)
+            slot.store(atomic_counted_ptr_t(new atomic_counted_object(i)));
+
+        done = true;
+        for (size_t i = 0; i < readers.size(); ++i)
+            readers[i].join();
+
+        EXPECT_EQ(kStores, slot.load()->value_);
+    }
+
+    epoch_domain::instance().synchronize();
+    EXPECT_EQ(static_cast<unsigned int>(kStores + 1),
+              atomic_counted_object::destroyed_.load());
+}
@@ -0,0 +1,281 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "handle_traits.h"
+
+/**
+ * \brief Identifies an object in a slot_map: index of its slot and the
+ *  generation of the slot when the object was inserted.
+ */
+struct slot_id {
+    uint32_t    index_;
+    uint32_t    generation_;
+};
+
+inline bool operator==(const slot_id& left, const slot_id& right) {
+    return left.index_ == right.index_ && left.generation_ == right.generation_;
+}
+
+inline bool operator!=(const slot_id& left, const slot_id& right) {
+    return !(left == right);
+}
+
+/**
+ * \brief Generational slot map. Objects are stored densely in a contiguous
+ *  array, and reached through a slot array that maps ids to positions in
+ *  the dense array. Insertion, removal and lookup are O(1); removal moves
+ *  the last object into the hole, so iteration is a linear scan of the live
+ *  objects, in no particular order. Every removal bumps the generation of
+ *  the slot, so ids of removed objects are detected as stale even after
+ *  their slot has been reused.
+ * \remarks Not thread safe. Pointers and iterators to the objects are
+ *  invalidated by insert() and erase(); ids are not.
+ * \see slot_handle_policy
+ */
+template<typename T>
+class slot_map {
+public :
+    typedef T                                       value_type;
+    typedef typename std::vector<T>::iterator       iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+private :
+    enum : uint32_t {
+        /*!< End of the free slot list. */
+        no_slot = ~static_cast<uint32_t>(0)
+    };
+
+    struct slot {
+        /*!< Position in values_ while in use, next free slot otherwise. */
+        uint32_t    target_;
+        /*!< Starts at 1, generation 0 is never valid. */
+        uint32_t    generation_;
+    };
+
+    /*!< Live objects, contiguous. */
+    std::vector<T>          values_;
+    /*!< Slot of each live object, parallel to values_. */
+    std::vector<uint32_t>   owners_;
+    std::vector<slot>       slots_;
+    /*!< Head of the free slot list. */
+    uint32_t                free_head_;
+
+    const slot* find_slot(const slot_id& id) const {
+        if (id.index_ >= slots_.size())
+            return nullptr;
+        const slot& candidate = slots_[id.index_];
+        return candidate.generation_ == id.generation_ ? &candidate : nullptr;
+    }
+
+public :
+    slot_map() : free_head_(no_slot) {}
+
+    /**
+     * \brief The id that no object ever has.
+     */
+    static slot_id null_id() {
+        slot_id id = { no_slot, 0 };
+        return id;
+    }
+
+    /**
+     * \brief Constructs an object from args and returns its id.
+     */
+    template<typename... Args>
+    slot_id insert(Args&&... args) {
+        assert(values_.size() < no_slot);
+        // The bookkeeping arrays grow before the object is constructed, and
+        // are rolled back if anything throws, so that the three stay parallel.
+        const bool fresh = free_head_ == no_slot;
+        const uint32_t index = fresh ? static_cast<uint32_t>(slots_.size())
+                                     : free_head_;
+        owners_.push_back(index);
+        if (fresh) {
+            slot unused = { 0, 1 };
+            try {
+                slots_.push_back(unused);
+            } catch (...) {
+                owners_.pop_back();
+                throw;
+            }
+        }
+        try {
+            values_.emplace_back(std::forward<Args>(args)...);
+        } catch (...) {
+            owners_.pop_back();
+            if (fresh)
+                slots_.pop_back();
+            throw;
+        }
+
+        if (!fresh)
+            free_head_ = slots_[index].target_;
+        slots_[index].target_ = static_cast<uint32_t>(values_.size() - 1);
+
+        slot_id id = { index, slots_[index].generation_ };
+        return id;
+    }
+
+    /**
+     * \brief Removes the object with the given id.
+     * \return False if the id is stale or null.
+     */
+    bool erase(const slot_id& id) {
+        if (!find_slot(id))
+            return false;
+
+        slot& removed = slots_[id.index_];
+        const uint32_t hole = removed.target_;
+        const uint32_t last = static_cast<uint32_t>(values_.size() - 1);
+        if (hole != last) {
+            values_[hole] = std::move(values_[last]);
+            owners_[hole] = owners_[last];
+            slots_[owners_[hole]].target_ = hole;
+        }
+        values_.pop_back();
+        owners_.pop_back();
+
+        if (++removed.generation_ == 0)
+            removed.generation_ = 1;
+        removed.target_ = free_head_;
+        free_head_ = id.index_;
+        return true;
+    }
+
+    /**
+     * \brief Returns the object with the given id, or nullptr if the id is
+     *  stale or null.
+     */
+    T* find(const slot_id& id) {
+        const slot* target = find_slot(id);
+        return target ? &values_[target->target_] : nullptr;
+    }
+
+    const T* find(const slot_id& id) const {
+        const slot* target = find_slot(id);
+        return target ? &values_[target->target_] : nullptr;
+    }
+
+    bool contains(const slot_id& id) const {
+        return find_slot(id) != nullptr;
+    }
+
+    /**
+     * \brief Removes all the objects. Outstanding ids become stale.
+     */
+    void clear() {
+        while (!owners_.empty()) {
+            slot_id id = { owners_.back(), slots_[owners_.back()].generation_ };
+            erase(id);
+        }
+    }
+
+    void reserve(size_t count) {
+        values_.reserve(count);
+        owners_.reserve(count);
+        slots_.reserve(count);
+    }
+
+    size_t size() const {
+        return values_.size();
+    }
+
+    bool empty() const {
+        return values_.empty();
+    }
+
+    /**
+     * \brief The live objects, as a contiguous array of size() elements.
+     */
+    T* data() {
+        return values_.data();
+    }
+
+    const T* data() const {
+        return values_.data();
+    }
+
+    iterator begin() {
+        return values_.begin();
+    }
+
+    iterator end() {
+        return values_.end();
+    }
+
+    const_iterator begin() const {
+        return values_.begin();
+    }
+
+    const_iterator end() const {
+        return values_.end();
+    }
+
+    /**
+     * \brief Id of the object at position index of the dense array.
+     */
+    slot_id id_at(size_t index) const {
+        slot_id id = { owners_[index], slots_[owners_[index]].generation_ };
+        return id;
+    }
+};
+
+/**
+ * \brief Management policy that makes slot ids usable as handles, so that
+ *  scoped_handle and shared_handle objects can own slots: disposing of a
+ *  handle erases the object from the map. provider must have a static
+ *  map() member function returning the slot_map; stale ids are ignored.
+ * \code
+ *  struct sessions {
+ *      static slot_map<session>& map();
+ *  };
+ *  scoped_handle<slot_handle_policy<sessions> > s(sessions::map().insert());
+ * \endcode
+ */
+template<typename provider>
+struct slot_handle_policy : public handle_traits_base<slot_id> {
+    static slot_id null_handle() {
+        slot_id id = { ~static_cast<uint32_t>(0), 0 };
+        return id;
+    }
+
+    static void dispose(const slot_id& id) {
+        if (id != null_handle())
+            provider::map().erase(id);
+    }
+};
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include "scoped_handle.h"
+#include "slot_map.h"
+
+TEST(slot_map, insert_find_erase) {
+    slot_map<std::string> names;
+    const slot_id alice = names.insert("alice");
+    const slot_id bob = names.insert("bob");
+    const slot_id carol = names.insert(3, 'c');
+    EXPECT_EQ(3u, names.size());
+    EXPECT_EQ("bob", *names.find(bob));
+    EXPECT_EQ("ccc", *names.find(carol));
+
+    EXPECT_TRUE(names.erase(alice));
+    EXPECT_FALSE(names.erase(alice));
+    EXPECT_TRUE(names.find(alice) == nullptr);
+    EXPECT_EQ("ccc", *names.find(carol));
+
+    // The slot is reused, with a new generation.
+    const slot_id dave = names.insert("dave");
+    EXPECT_EQ(alice.index_, dave.index_);
+    EXPECT_NE(alice, dave);
+    EXPECT_FALSE(names.contains(alice));
+    EXPECT_EQ("dave", *names.find(dave));
+    EXPECT_FALSE(names.contains(slot_map<std::string>::null_id()));
+}
+
+TEST(slot_map, dense_iteration) {
+    slot_map<int> values;
+    slot_id ids[10];
+    for (int i = 0; i < 10; ++i)
+        ids[i] = values.insert(i);
+    for (int i = 0; i < 10; i += 2)
+        values.erase(ids[i]);
+
+    EXPECT_EQ(5u, values.size());
+    EXPECT_EQ(1 + 3 + 5 + 7 + 9, std::accumulate(values.begin(), values.end(), 0));
+    for (size_t i = 0; i < values.size(); ++i)
+        EXPECT_EQ(values.data()[i], *values.find(values.id_at(i)));
+
+    values.clear();
+    EXPECT_TRUE(values.empty());
+    EXPECT_FALSE(values.contains(ids[1]));
+}
+
+namespace {
+
+struct checked {
+    int value_;
+
+    explicit checked(int value) : value_(value) {
+        if (value < 0)
+            throw std::invalid_argument("negative");
+    }
+};
+
+} // anonymous namespace
+
+TEST(slot_map, insert_is_rolled_back_on_throw) {
+    slot_map<checked> values;
+    const slot_id first = values.insert(1);
+    const slot_id second = values.insert(2);
+
+    // Once with a fresh slot, once with a free one.
+    EXPECT_THROW(values.insert(-1), std::invalid_argument);
+    values.erase(first);
+    EXPECT_THROW(values.insert(-1), std::invalid_argument);
+    EXPECT_EQ(1u, values.size());
+
+    const slot_id third = values.insert(3);
+    EXPECT_EQ(first.index_, third.index_);
+    const slot_id fourth = values.insert(4);
+    EXPECT_EQ(2u, fourth.index_);
+    EXPECT_EQ(3u, values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        EXPECT_EQ(values.data()[i].value_, values.find(values.id_at(i))->value_);
+    EXPECT_EQ(2, values.find(second)->value_);
+}
+
+namespace {
+
+struct widgets {
+    static slot_map<int>& map() {
+        static slot_map<int> instance;
+        return instance;
+    }
+};
+
+} // anonymous namespace
+
+TEST(slot_map, owned_by_handles) {
+    typedef slot_handle_policy<widgets> policy_t;
+    slot_id id;
+    {
+        scoped_handle<policy_t> widget(widgets::map().insert(7));
+        id = scoped_handle_get(widget);
+        EXPECT_EQ(7, *widgets::map().find(id));
+
+        shared_handle<policy_t> shared(widgets::map().insert(8));
+        {
+            shared_handle<policy_t> copy(shared);
+            EXPECT_EQ(2u, widgets::map().size());
+        }
+        EXPECT_EQ(2u, widgets::map().size());
+    }
+    EXPECT_TRUE(widgets::map().empty());
+    EXPECT_FALSE(widgets::map().contains(id));
+}
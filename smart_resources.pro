@@ -9,21 +9,56 @@ unix {
 }
 
 SOURCES += main.cpp \
+    aligned_array_unittests.cc \
+    deferred_dispose_unittests.cc \
+    inline_scoped_pointer_unittests.cc \
+    io_uring_engine_unittests.cc \
+    lock_unittests.cc \
+    memory_mapping_unittests.cc \
     scoped_handle_unittests.cc \
-    shared_handle_unittests.cc
+    handle_pool_unittests.cc \
+    shared_handle_unittests.cc \
+    shared_pointer_unittests.cc \
+    slot_map_unittests.cc \
+    storage_policy_unittests.cc
 
 HEADERS += \
     scoped_handle.h \
+    handle_pool.h \
+    deferred_dispose.h \
+    io_uring_engine.h \
+    memory_mapping.h \
+    slot_map.h \
     fundamental_types.h \
     compound_types.h \
     shared_handle.h \
+    handle_ownership.h \
+    fd_refcount_table.h \
     handle_traits.h \
     scoped_pointer.h \
+    inline_scoped_pointer.h \
     shared_pointer.h \
+    weak_pointer.h \
+    epoch_reclamation.h \
+    atomic_shared_pointer.h \
     pointer_policies.h \
+    memory_pool.h \
+    monotonic_arena.h \
+    aligned_array.h \
     intrusive_refcount_impl.h \
+    biased_refcount_impl.h \
+    shared_control_block.h \
     function_types.h \
     auto_lock.h \
     posix_lock.h \
+    futex_lock.h \
+    spin_lock.h \
+    biased_rwlock.h \
+    seqlock.h \
+    lock_profiling.h \
+    multi_lock.h \
+    striped_lock.h \
+    lock_waiter.h \
+    cpu_relax.h \
     scoped_lock.h
 
@@ -0,0 +1,180 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "cpu_relax.h"
+
+/**
+ * \brief Lock traits for a ticket spinlock, usable with scoped_lock and
+ *      auto_lock. Threads take a ticket and are served in FIFO order. While
+ *      waiting, a thread pauses for a time proportional to the number of
+ *      threads ahead of it, which keeps the polling of the shared counter
+ *      down when the queue is long.
+ * \remarks Never sleeps: meant for short critical sections. A waiter that
+ *      has spun for a while yields the processor between polls (see
+ *      spin_backoff), but since the lock is FIFO, a preempted waiter still
+ *      holds up the ones queued behind it; avoid running more threads than
+ *      cores. The lock word occupies a cache line of its own.
+ */
+struct ticket_lock_traits {
+    struct alignas(64) lock_t {
+        /*!< Next ticket to hand out. */
+        std::atomic<uint32_t>   next_;
+        /*!< Ticket of the current owner. */
+        std::atomic<uint32_t>   serving_;
+    };
+
+    enum {
+        /*!< Pause instructions per thread ahead in the queue. */
+        pauses_per_waiter = 32
+    };
+
+    static bool initialize(lock_t& lock) {
+        lock.next_.store(0, std::memory_order_relaxed);
+        lock.serving_.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void dispose(lock_t&) {}
+
+    static void acquire(lock_t& lock) {
+        const uint32_t ticket = lock.next_.fetch_add(1, std::memory_order_relaxed);
+        spin_backoff backoff;
+        for (;;) {
+            const uint32_t serving = lock.serving_.load(std::memory_order_acquire);
+            if (serving == ticket)
+                return;
+            backoff.wait((ticket - serving) * pauses_per_waiter);
+        }
+    }
+
+    static bool try_acquire(lock_t& lock) {
+        uint32_t serving = lock.serving_.load(std::memory_order_relaxed);
+        return lock.next_.compare_exchange_strong(serving, serving + 1,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+    }
+
+    static void release(lock_t& lock) {
+        // Only the owner writes serving_.
+        lock.serving_.store(lock.serving_.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_release);
+    }
+};
+
+/**
+ * \brief Queue node of a thread waiting for, or holding, an MCS lock. Each
+ *      node has a cache line of its own, so that a waiting thread spins on
+ *      a line no other waiter touches.
+ */
+struct alignas(64) mcs_node {
+    std::atomic<mcs_node*>  next_;
+    std::atomic<bool>       locked_;
+};
+
+/**
+ * \brief Lock traits for an MCS queue lock. Waiters form a linked queue of
+ *      mcs_node objects; each one spins on its own node until its
+ *      predecessor hands the lock over, so contention does not generate
+ *      coherence traffic on a shared line, and the lock is granted in FIFO
+ *      order.
+ *      Every acquisition needs a node that stays valid until the matching
+ *      release. The traits declare it as waiter_t, so auto_lock provides
+ *      one on the stack of the calling thread, and scoped_lock forwards it:
+ * \code
+ *  scoped_lock<mcs_lock_traits> lock;
+ *  {
+ *      auto_lock<scoped_lock<mcs_lock_traits> > guard(lock);
+ *  }
+ * \endcode
+ * \remarks Never sleeps, and has the same sensitivity to preemption as
+ *      ticket_lock_traits.
+ */
+struct mcs_lock_traits {
+    typedef mcs_node    waiter_t;
+
+    struct alignas(64) lock_t {
+        /*!< Last node in the queue, nullptr when the lock is free. */
+        std::atomic<mcs_node*>  tail_;
+    };
+
+    static bool initialize(lock_t& lock) {
+        lock.tail_.store(nullptr, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void dispose(lock_t&) {}
+
+    static void acquire(lock_t& lock, waiter_t& node) {
+        node.next_.store(nullptr, std::memory_order_relaxed);
+        node.locked_.store(true, std::memory_order_relaxed);
+
+        mcs_node* predecessor = lock.tail_.exchange(&node,
+                                                    std::memory_order_acq_rel);
+        if (!predecessor)
+            return;
+
+        predecessor->next_.store(&node, std::memory_order_release);
+        spin_backoff backoff;
+        while (node.locked_.load(std::memory_order_acquire))
+            backoff.wait();
+    }
+
+    static bool try_acquire(lock_t& lock, waiter_t& node) {
+        node.next_.store(nullptr, std::memory_order_relaxed);
+        node.locked_.store(true, std::memory_order_relaxed);
+
+        mcs_node* expected = nullptr;
+        return lock.tail_.compare_exchange_strong(expected, &node,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed);
+    }
+
+    static void release(lock_t& lock, waiter_t& node) {
+        mcs_node* successor = node.next_.load(std::memory_order_acquire);
+        if (!successor) {
+            mcs_node* expected = &node;
+            if (lock.tail_.compare_exchange_strong(expected, nullptr,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed))
+                return;
+
+            // A thread has queued itself, but has not linked its node yet.
+            spin_backoff backoff;
+            while (!(successor = node.next_.load(std::memory_order_acquire)))
+                backoff.wait();
+        }
+        successor->locked_.store(false, std::memory_order_release);
+    }
+};
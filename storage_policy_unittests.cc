@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "memory_pool.h"
+#include "monotonic_arena.h"
+#include "scoped_pointer.h"
+#include "shared_pointer.h"
+
+struct pooled_object : public atomic_intrusive_refcount_impl {
+    static std::atomic<unsigned int> destroyed_;
+
+    int value_;
+
+    explicit pooled_object(int value) : value_(value) {}
+
+    ~pooled_object() {
+        ++destroyed_;
+    }
+};
+
+std::atomic<unsigned int> pooled_object::destroyed_(0);
+
+TEST(memory_pool, reuses_released_blocks) {
+    void* first = memory_pool::allocate(24);
+    memory_pool::deallocate(first);
+    void* second = memory_pool::allocate(32);
+    EXPECT_EQ(first, second);
+    memory_pool::deallocate(second);
+}
+
+TEST(memory_pool, serves_large_and_small_sizes) {
+    std::vector<void*> blocks;
+    for (size_t size = 0; size <= 2 * memory_pool::max_small_size; size += 7) {
+        void* block = memory_pool::allocate(size);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) % memory_pool::alignment);
+        memset(block, 0xAB, size);
+        blocks.push_back(block);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+        memory_pool::deallocate(blocks[i]);
+}
+
+TEST(memory_pool, remote_release) {
+    const int kCount = 10000;
+    std::vector<void*> blocks;
+    for (int i = 0; i < kCount; ++i)
+        blocks.push_back(memory_pool::allocate(48));
+
+    std::thread releaser([&blocks]() {
+        for (size_t i = 0; i < blocks.size(); ++i)
+            memory_pool::deallocate(blocks[i]);
+    });
+    releaser.join();
+
+    // Once the local free list runs dry, the blocks released by the other
+    // thread are handed out again.
+    for (int i = 0; i < kCount; ++i)
+        blocks[i] = memory_pool::allocate(48);
+    for (int i = 0; i < kCount; ++i)
+        memory_pool::deallocate(blocks[i]);
+}
+
+TEST(pooled_storage, scoped_ptr) {
+    pooled_object::destroyed_ = 0;
+    pooled_storage<pooled_object>::prewarm(16);
+    {
+        scoped_ptr<pooled_object, pooled_storage> ptr(
+                    pooled_storage<pooled_object>::create(42));
+        EXPECT_EQ(42, ptr->value_);
+    }
+    EXPECT_EQ(1u, pooled_object::destroyed_);
+}
+
+TEST(pooled_storage, shared_pointer_across_threads) {
+    typedef shared_pointer<pooled_object, atomic_intrusive_refcount,
+                           pooled_storage> pointer_t;
+    pooled_object::destroyed_ = 0;
+
+    std::vector<pointer_t> pointers;
+    for (int i = 0; i < 100; ++i)
+        pointers.push_back(pointer_t(pooled_storage<pooled_object>::create(i)));
+
+    std::thread consumer([&pointers]() {
+        pointers.clear();
+    });
+    consumer.join();
+
+    EXPECT_EQ(100u, pooled_object::destroyed_);
+}
+
+struct arena_object {
+    static unsigned int destroyed_;
+
+    double value_;
+
+    explicit arena_object(double value) : value_(value) {}
+
+    ~arena_object() {
+        ++destroyed_;
+    }
+};
+
+unsigned int arena_object::destroyed_ = 0;
+
+TEST(monotonic_arena, allocate_and_reset) {
+    monotonic_arena arena(64);
+    char* first = static_cast<char*>(arena.allocate(10, 1));
+    char* second = static_cast<char*>(arena.allocate(8, 8));
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(second) % 8);
+    EXPECT_LE(first + 10, second);
+
+    // Bigger than the chunk size.
+    void* large = arena.allocate(1000);
+    ASSERT_TRUE(large != nullptr);
+    memset(large, 0, 1000);
+
+    const size_t capacity = arena.capacity();
+    arena.reset();
+    EXPECT_LE(arena.capacity(), capacity);
+    EXPECT_EQ(large, arena.allocate(1000));
+    EXPECT_EQ(capacity, arena.capacity() + 64);
+}
+
+TEST(arena_storage, scoped_ptr_runs_destructor) {
+    arena_object::destroyed_ = 0;
+    monotonic_arena arena;
+    for (int i = 0; i < 100; ++i) {
+        scoped_ptr<arena_object, arena_storage> ptr(
+                    arena.create<arena_object>(i * 0.5));
+        EXPECT_EQ(i * 0.5, ptr->value_);
+    }
+    EXPECT_EQ(100u, arena_object::destroyed_);
+    arena.reset();
+}
@@ -0,0 +1,210 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+
+#include "auto_lock.h"
+#include "scoped_lock.h"
+
+/**
+ * \brief Array of stripe_count locks, each on its own cache line, that
+ *      shards one logical lock by key: a key always maps to the same
+ *      stripe, so operations on keys in different stripes do not contend.
+ *      Works with any traits class accepted by scoped_lock.
+ * \remarks Lock stripes through auto_stripe_lock, auto_stripes_lock and
+ *      auto_all_stripes_lock. They acquire stripes in increasing index
+ *      order, so they can be mixed without deadlocking. Before C++17, a
+ *      striped_lock allocated with new may not start on a cache line.
+ */
+template<typename LockTraits, size_t stripe_count = 16>
+class striped_lock {
+public :
+    typedef scoped_lock<LockTraits>                 lock_t;
+    typedef striped_lock<LockTraits, stripe_count>  self_t;
+    typedef typename lock_t::waiter_t               waiter_t;
+
+    enum {
+        stripes = stripe_count
+    };
+
+    static_assert(stripe_count > 0, "striped_lock needs at least one stripe");
+
+private :
+    struct alignas(64) stripe {
+        lock_t  lock_;
+    };
+
+    stripe  stripes_[stripe_count];
+
+public :
+    striped_lock() = default;
+
+    striped_lock(const self_t&) = delete;
+    self_t& operator=(const self_t&) = delete;
+
+    /**
+     * \brief Index of the stripe guarding a key. The std::hash value is
+     *      mixed first, since it is the identity for integers and pointers.
+     */
+    template<typename Key>
+    static size_t stripe_of(const Key& key) {
+        uint64_t hash = static_cast<uint64_t>(std::hash<Key>()(key));
+        hash *= 0x9e3779b97f4a7c15ULL;
+        return static_cast<size_t>((hash ^ (hash >> 32)) % stripe_count);
+    }
+
+    /**
+     * \brief The lock of a stripe.
+     */
+    lock_t& stripe_at(size_t index) {
+        return stripes_[index].lock_;
+    }
+
+    /**
+     * \brief The lock of the stripe guarding a key.
+     */
+    template<typename Key>
+    lock_t& stripe_for(const Key& key) {
+        return stripe_at(stripe_of(key));
+    }
+};
+
+/**
+ * \brief Holds the stripe of one key, for the lifetime of the object.
+ */
+template<typename StripedLockT>
+class auto_stripe_lock {
+private :
+    auto_lock<typename StripedLockT::lock_t>    guard_;
+
+public :
+    template<typename Key>
+    auto_stripe_lock(StripedLockT& lock, const Key& key)
+        : guard_(lock.stripe_for(key)) {}
+
+    auto_stripe_lock(const auto_stripe_lock&) = delete;
+    auto_stripe_lock& operator=(const auto_stripe_lock&) = delete;
+};
+
+/**
+ * \brief Holds the stripes of several keys, for the lifetime of the object.
+ *      Each stripe is acquired once, even if several of the keys map to it.
+ */
+template<typename StripedLockT>
+class auto_stripes_lock {
+private :
+    typedef typename StripedLockT::lock_t       lock_t;
+    typedef typename StripedLockT::waiter_t     waiter_t;
+
+    StripedLockT&                           lock_;
+    std::bitset<StripedLockT::stripes>      held_;
+    /*!< Queue nodes of this thread, for locks that need one */
+    waiter_t                                waiters_[StripedLockT::stripes];
+
+    void acquire_held() {
+        for (size_t i = 0; i < held_.size(); ++i)
+            if (held_[i])
+                lock_waiter_ops<lock_t>::acquire(lock_.stripe_at(i),
+                                                 waiters_[i]);
+    }
+
+public :
+    template<typename Key>
+    auto_stripes_lock(StripedLockT& lock, std::initializer_list<Key> keys)
+        : lock_(lock) {
+        for (const Key& key : keys)
+            held_.set(StripedLockT::stripe_of(key));
+        acquire_held();
+    }
+
+    /**
+     * \brief Locks the stripes of the keys in [first, last).
+     */
+    template<typename Iterator>
+    auto_stripes_lock(StripedLockT& lock, Iterator first, Iterator last)
+        : lock_(lock) {
+        for (; first != last; ++first)
+            held_.set(StripedLockT::stripe_of(*first));
+        acquire_held();
+    }
+
+    ~auto_stripes_lock() {
+        for (size_t i = held_.size(); i-- > 0; )
+            if (held_[i])
+                lock_waiter_ops<lock_t>::release(lock_.stripe_at(i),
+                                                 waiters_[i]);
+    }
+
+    /**
+     * \brief Number of distinct stripes held.
+     */
+    size_t count() const {
+        return held_.count();
+    }
+
+    auto_stripes_lock(const auto_stripes_lock&) = delete;
+    auto_stripes_lock& operator=(const auto_stripes_lock&) = delete;
+};
+
+/**
+ * \brief Holds every stripe, for the lifetime of the object; eg. to resize or
+ *      iterate the whole structure.
+ */
+template<typename StripedLockT>
+class auto_all_stripes_lock {
+private :
+    typedef typename StripedLockT::lock_t       lock_t;
+    typedef typename StripedLockT::waiter_t     waiter_t;
+
+    StripedLockT&   lock_;
+    /*!< Queue nodes of this thread, for locks that need one */
+    waiter_t        waiters_[StripedLockT::stripes];
+
+public :
+    explicit auto_all_stripes_lock(StripedLockT& lock) : lock_(lock) {
+        for (size_t i = 0; i < StripedLockT::stripes; ++i)
+            lock_waiter_ops<lock_t>::acquire(lock_.stripe_at(i), waiters_[i]);
+    }
+
+    ~auto_all_stripes_lock() {
+        for (size_t i = StripedLockT::stripes; i-- > 0; )
+            lock_waiter_ops<lock_t>::release(lock_.stripe_at(i), waiters_[i]);
+    }
+
+    auto_all_stripes_lock(const auto_all_stripes_lock&) = delete;
+    auto_all_stripes_lock& operator=(const auto_all_stripes_lock&) = delete;
+};
@@ -0,0 +1,176 @@
+//
+//Copyright (c) 2011,2012, Adrian Hodos
+//All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//    1. Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//    2. Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//    3. All advertising materials mentioning features or use of this software
+//       must display the following acknowledgement:
+//       This product includes software developed by the <authors>.
+//    4. Neither the name of the author(s) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY
+//  EXPRESS OR IMPLIED WARRANTIES,
+//  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+//  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <utility>
+#include "shared_pointer.h"
+
+/**
+ * \brief Non owning reference to an object managed by shared_pointer
+ *      objects. A weak_pointer does not keep the object alive, but can be
+ *      turned into a shared_pointer, if the object still exists, by calling
+ *      weak_ptr_lock(). Locking never blocks: it increments the reference
+ *      count only if it is not already zero.
+ * \remarks The reference_policy<T> policy must expose the shared_control_block
+ *      of an object, through a static function called control_block(). The
+ *      control_block_refcount and weak_intrusive_refcount policies do so.
+ *      For objects created by make_shared_pointer, the memory of the object
+ *      is released only after the last weak_pointer to it expires.
+ * \see shared_pointer, shared_control_block
+ */
+template<
+        typename T,
+        template<typename> class reference_policy = weak_intrusive_refcount,
+        template<typename> class storage_policy = default_storage,
+        template<typename> class checking_policy = assert_check
+> class weak_pointer {
+public :
+    typedef reference_policy<T>                                 refpolicy_t;
+    typedef shared_pointer<
+        T, reference_policy, storage_policy, checking_policy
+    > shared_t;
+    typedef weak_pointer<
+        T, reference_policy, storage_policy, checking_policy
+    > self_t;
+
+private :
+    /*!< Referenced object, valid only while the strong count is not 0. */
+    T*                      pointee_;
+    /*!< Counts of the referenced object. */
+    shared_control_block*   block_;
+
+    void assign(T* ptr, shared_control_block* block) {
+        if (block)
+            block->add_weak_ref();
+        if (block_)
+            block_->release_weak_ref();
+        pointee_ = ptr;
+        block_ = block;
+    }
+
+    shared_t lock() const {
+        if (block_ && block_->try_add_ref())
+            return shared_t(pointee_);
+        return shared_t();
+    }
+
+    bool expired() const {
+        return !block_ || block_->strong_.load(std::memory_order_relaxed) == 0;
+    }
+
+    void swap(self_t& right) {
+        std::swap(pointee_, right.pointee_);
+        std::swap(block_, right.block_);
+    }
+
+public :
+    weak_pointer() : pointee_(nullptr), block_(nullptr) {}
+
+    /**
+     * \brief Refer to the object owned by a shared_pointer.
+     */
+    weak_pointer(const shared_t& sp) : pointee_(nullptr), block_(nullptr) {
+        if (sp)
+            assign(shared_ptr_get(sp),
+                   refpolicy_t::control_block(shared_ptr_get(sp)));
+    }
+
+    weak_pointer(const self_t& right) : pointee_(nullptr), block_(nullptr) {
+        assign(right.pointee_, right.block_);
+    }
+
+    weak_pointer(self_t&& right)
+        : pointee_(right.pointee_), block_(right.block_) {
+        right.pointee_ = nullptr;
+        right.block_ = nullptr;
+    }
+
+    ~weak_pointer() {
+        if (block_)
+            block_->release_weak_ref();
+    }
+
+    self_t& operator=(const self_t& right) {
+        assign(right.pointee_, right.block_);
+        return *this;
+    }
+
+    self_t& operator=(self_t&& right) {
+        if (this != &right) {
+            if (block_)
+                block_->release_weak_ref();
+            pointee_ = right.pointee_;
+            block_ = right.block_;
+            right.pointee_ = nullptr;
+            right.block_ = nullptr;
+        }
+        return *this;
+    }
+
+    self_t& operator=(const shared_t& sp) {
+        if (sp)
+            assign(shared_ptr_get(sp),
+                   refpolicy_t::control_block(shared_ptr_get(sp)));
+        else
+            assign(nullptr, nullptr);
+        return *this;
+    }
+
+    /**
+     * \brief Get a shared_pointer to the referenced object.
+     * \return A shared_pointer owning a new reference to the object, or
+     *      a null shared_pointer if the object was already destroyed.
+     */
+    friend inline shared_t weak_ptr_lock(const self_t& wp) {
+        return wp.lock();
+    }
+
+    /**
+     * \brief Test if the referenced object was destroyed.
+     * \remarks The result may be stale by the time it is used if other
+     *      threads hold references. Use weak_ptr_lock() to access the object.
+     */
+    friend inline bool weak_ptr_expired(const self_t& wp) {
+        return wp.expired();
+    }
+
+    /**
+     * \brief Stop referring to the object.
+     */
+    friend inline void weak_ptr_reset(self_t& wp) {
+        wp.assign(nullptr, nullptr);
+    }
+
+    friend inline void swap(self_t& left, self_t& right) {
+        left.swap(right);
+    }
+};